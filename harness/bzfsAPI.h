@@ -0,0 +1,352 @@
+// stagedSceneGenerator
+// A stand-in for the parts of the bzfs plugin API that the plugin uses, so it can be built and benchmarked
+// without a bzfs source tree. The declarations follow include/bzfsAPI.h. See harness/README.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#ifndef BZFS_API_H
+#define BZFS_API_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define BZF_API
+#define BZ_API_VERSION 1
+
+#define BZ_SERVER    -2
+#define BZ_ALLUSERS  -1
+#define BZ_NULLUSER  -3
+
+typedef enum
+{
+    eNoTeam = -1,
+    eRogueTeam = 0,
+    eRedTeam,
+    eGreenTeam,
+    eBlueTeam,
+    ePurpleTeam,
+    eRabbitTeam,
+    eHunterTeam,
+    eObservers,
+    eAdministrators
+} bz_eTeamType;
+
+typedef enum
+{
+    eDead,
+    eAlive,
+    ePaused,
+    eExploding,
+    eTeleporting,
+    eInBuilding
+} bz_ePlayerStatus;
+
+// Only the events the plugin registers for
+typedef enum
+{
+    bz_eNullEvent = 0,
+    bz_eGetAutoTeamEvent,
+    bz_eGetPlayerSpawnPosEvent,
+    bz_ePlayerSpawnEvent,
+    bz_ePlayerDieEvent,
+    bz_ePlayerUpdateEvent,
+    bz_ePlayerPartEvent,
+    bz_eTickEvent,
+    bz_eBZDBChange,
+    bz_eLastEvent
+} bz_eEventType;
+
+class bz_ApiString
+{
+public:
+    bz_ApiString() {}
+    bz_ApiString(const char* c) : data(c ? c : "") {}
+    bz_ApiString(const std::string &s) : data(s) {}
+
+    const char* c_str() const { return data.c_str(); }
+    unsigned int size() const { return (unsigned int)data.size(); }
+    bool operator==(const char* c) const { return data == (c ? c : ""); }
+    bool operator!=(const char* c) const { return !(*this == c); }
+
+private:
+    std::string data;
+};
+
+class bz_APIStringList
+{
+public:
+    void push_back(const bz_ApiString &s) { data.push_back(s); }
+    unsigned int size() const { return (unsigned int)data.size(); }
+    const bz_ApiString& get(unsigned int i) const { return i < data.size() ? data[i] : empty; }
+    const bz_ApiString& operator[](unsigned int i) const { return get(i); }
+
+private:
+    std::vector<bz_ApiString> data;
+    bz_ApiString empty;
+};
+
+typedef struct
+{
+    bz_ePlayerStatus status;
+    bool crouching;
+    bool falling;
+    bool zoned;
+    bool inPhantomZone;
+    float pos[3];
+    float rotation;
+    float velocity[3];
+    float angVel;
+    int phydrv;
+} bz_PlayerUpdateState;
+
+class bz_EventData
+{
+public:
+    bz_EventData(bz_eEventType type = bz_eNullEvent) : version(1), eventType(type), eventTime(0.0) {}
+    virtual ~bz_EventData() {}
+
+    int version;
+    bz_eEventType eventType;
+    double eventTime;
+};
+
+class bz_GetAutoTeamEventData_V1 : public bz_EventData
+{
+public:
+    bz_GetAutoTeamEventData_V1() : bz_EventData(bz_eGetAutoTeamEvent), playerID(-1), team(eNoTeam), handled(false) {}
+
+    int playerID;
+    bz_ApiString callsign;
+    bz_eTeamType team;
+    bool handled;
+};
+
+class bz_GetPlayerSpawnPosEventData_V1 : public bz_EventData
+{
+public:
+    bz_GetPlayerSpawnPosEventData_V1() : bz_EventData(bz_eGetPlayerSpawnPosEvent), playerID(-1), team(eNoTeam),
+        handled(false), pos(), rot(0.0f) {}
+
+    int playerID;
+    bz_eTeamType team;
+    bool handled;
+    float pos[3];
+    float rot;
+};
+
+class bz_PlayerSpawnEventData_V1 : public bz_EventData
+{
+public:
+    bz_PlayerSpawnEventData_V1() : bz_EventData(bz_ePlayerSpawnEvent), playerID(-1), team(eNoTeam), state() {}
+
+    int playerID;
+    bz_eTeamType team;
+    bz_PlayerUpdateState state;
+};
+
+class bz_PlayerDieEventData_V1 : public bz_EventData
+{
+public:
+    bz_PlayerDieEventData_V1() : bz_EventData(bz_ePlayerDieEvent), playerID(-1), team(eNoTeam), killerID(-1),
+        killerTeam(eNoTeam), shotID(-1), state() {}
+
+    int playerID;
+    bz_eTeamType team;
+    int killerID;
+    bz_eTeamType killerTeam;
+    bz_ApiString flagKilledWith;
+    int shotID;
+    bz_PlayerUpdateState state;
+};
+
+class bz_PlayerDieEventData_V2 : public bz_PlayerDieEventData_V1
+{
+public:
+    bz_PlayerDieEventData_V2() : flagHeldWhenKilled(-1) { version = 2; }
+
+    int flagHeldWhenKilled;
+};
+
+class bz_PlayerUpdateEventData_V1 : public bz_EventData
+{
+public:
+    bz_PlayerUpdateEventData_V1() : bz_EventData(bz_ePlayerUpdateEvent), playerID(-1), state(), lastState(),
+        stateTime(0.0) {}
+
+    int playerID;
+    bz_PlayerUpdateState state;
+    bz_PlayerUpdateState lastState;
+    double stateTime;
+};
+
+class bz_BasePlayerRecord;
+
+class bz_PlayerJoinPartEventData_V1 : public bz_EventData
+{
+public:
+    bz_PlayerJoinPartEventData_V1() : bz_EventData(bz_ePlayerPartEvent), playerID(-1), record(NULL) {}
+
+    int playerID;
+    bz_BasePlayerRecord* record;
+    bz_ApiString reason;
+};
+
+class bz_TickEventData_V1 : public bz_EventData
+{
+public:
+    bz_TickEventData_V1() : bz_EventData(bz_eTickEvent) {}
+};
+
+class bz_BZDBChangeData_V1 : public bz_EventData
+{
+public:
+    bz_BZDBChangeData_V1() : bz_EventData(bz_eBZDBChange) {}
+
+    bz_ApiString key;
+    bz_ApiString value;
+};
+
+class bz_Plugin
+{
+public:
+    bz_Plugin() : MaxWaitTime(-1.0f), Unloadable(true) {}
+    virtual ~bz_Plugin() {}
+
+    virtual const char* Name() = 0;
+    virtual void Init(const char* config) = 0;
+    virtual void Cleanup() { Flush(); }
+    virtual void Event(bz_EventData* /*eventData*/) {}
+
+    float MaxWaitTime;
+    bool Unloadable;
+
+protected:
+    bool Register(bz_eEventType eventType);
+    bool Remove(bz_eEventType eventType);
+    void Flush();
+};
+
+class bz_CustomSlashCommandHandler
+{
+public:
+    virtual ~bz_CustomSlashCommandHandler() {}
+    virtual bool SlashCommand(int playerID, bz_ApiString command, bz_ApiString message, bz_APIStringList* params) = 0;
+};
+
+#define BZ_PLUGIN(n) \
+    extern "C" bz_Plugin* bz_GetPlugin(void) { return new n; } \
+    extern "C" void bz_FreePlugin(bz_Plugin* plugin) { delete plugin; } \
+    extern "C" int bz_GetMinVersion(void) { return BZ_API_VERSION; }
+
+typedef enum
+{
+    eNullObject,
+    eSolidObject,
+    eTeleporterField,
+    eWorldWeapon
+} bz_eWorldObjectType;
+
+class bz_APIBaseWorldObject
+{
+public:
+    bz_APIBaseWorldObject() : type(eNullObject), id(0) {}
+    virtual ~bz_APIBaseWorldObject() {}
+
+    bz_eWorldObjectType type;
+    bz_ApiString name;
+    uint32_t id;
+};
+
+class bz_APISolidWorldObject_V1 : public bz_APIBaseWorldObject
+{
+public:
+    bz_APISolidWorldObject_V1() : center(), maxAABBox(), minAABBox(), rotation(), maxBBox(), minBBox()
+    {
+        type = eSolidObject;
+    }
+
+    float center[3];
+    float maxAABBox[3];
+    float minAABBox[3];
+    float rotation[3];
+    float maxBBox[3];
+    float minBBox[3];
+};
+
+class bz_APIWorldObjectList
+{
+public:
+    unsigned int size() { return (unsigned int)objects.size(); }
+    bz_APIBaseWorldObject* get(unsigned int i) { return i < objects.size() ? objects[i] : NULL; }
+
+    std::vector<bz_APIBaseWorldObject*> objects;
+};
+
+BZF_API void bz_debugMessage(int level, const char* message);
+BZF_API void bz_debugMessagef(int level, const char* fmt, ...);
+BZF_API int bz_getDebugLevel(void);
+
+BZF_API double bz_getCurrentTime(void);
+BZF_API void bz_shutdown(void);
+
+BZF_API double bz_getBZDBDouble(const char* variable);
+BZF_API bool bz_updateBZDBDouble(const char* variable, double value, int perms = 0, bool persistent = false);
+BZF_API bool bz_updateBZDBBool(const char* variable, bool value, int perms = 0, bool persistent = false);
+
+BZF_API uint32_t bz_fireServerShot(const char* shotType, float origin[3], float vector[3], bz_eTeamType color = eRogueTeam,
+    int targetPlayerId = -1);
+
+BZF_API bool bz_setPlayerSpawnable(int playerID, bool spawn);
+BZF_API bool bz_killPlayer(int playerID, bool spawnOnBase, int killerID = -1, const char* flagID = NULL);
+BZF_API bool bz_givePlayerFlag(int playerID, const char* flagType, bool force);
+BZF_API const char* bz_getPlayerCallsign(int playerID);
+BZF_API bz_eTeamType bz_getPlayerTeam(int playerID);
+BZF_API bool bz_hasPerm(int playerID, const char* perm);
+
+BZF_API bool bz_sendTextMessage(int from, int to, const char* message);
+BZF_API bool bz_sendTextMessagef(int from, int to, const char* fmt, ...);
+
+BZF_API bool bz_registerCustomSlashCommand(const char* command, bz_CustomSlashCommandHandler* handler);
+BZF_API bool bz_removeCustomSlashCommand(const char* command);
+
+BZF_API bz_APIWorldObjectList* bz_getWorldObjectList(void);
+BZF_API void bz_releaseWorldObjectList(bz_APIWorldObjectList* list);
+
+#endif // BZFS_API_H
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
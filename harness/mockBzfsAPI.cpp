@@ -0,0 +1,386 @@
+// stagedSceneGenerator
+// The stand-in bzfs API. Every call the plugin makes is counted and, unless turned off, recorded in the
+// MockServer. See harness/README.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "bzfsAPI.h"
+#include "mockServer.h"
+
+#include <algorithm>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+MockServer& mockServer()
+{
+    static MockServer server;
+    return server;
+}
+
+MockServer::MockServer()
+{
+    reset();
+}
+
+void MockServer::reset()
+{
+    currentTime = 0.0;
+    debugLevel = 0;
+    shutdownRequested = false;
+    plugin = NULL;
+    std::fill(registered, registered + bz_eLastEvent, false);
+    commands.clear();
+    players.clear();
+    world.clear();
+    clearCalls();
+    nextShotID = 1;
+
+    // The bzfs defaults for everything the plugin reads
+    bzdb.clear();
+    bzdb["_explodeTime"] = 5.0;
+    bzdb["_flagAltitude"] = 11.0;
+    bzdb["_gravity"] = -9.8;
+    bzdb["_laserAdLife"] = 0.1;
+    bzdb["_mGunAdVel"] = 1.5;
+    bzdb["_reloadTime"] = 3.5;
+    bzdb["_rFireAdVel"] = 1.5;
+    bzdb["_shotRange"] = 350.0;
+    bzdb["_shotSpeed"] = 100.0;
+    bzdb["_tankAngVel"] = 0.785398;
+    bzdb["_tankSpeed"] = 25.0;
+    bzdb["_thiefAdLife"] = 0.05;
+    bzdb["_worldSize"] = 800.0;
+}
+
+void MockServer::clearCalls()
+{
+    std::fill(callCounts, callCounts + CallTypeCount, 0);
+    calls.clear();
+}
+
+bool MockServer::dispatch(bz_EventData &eventData)
+{
+    if (plugin == NULL || eventData.eventType <= bz_eNullEvent || eventData.eventType >= bz_eLastEvent
+        || !registered[eventData.eventType])
+        return false;
+
+    plugin->Event(&eventData);
+    return true;
+}
+
+bool MockServer::command(int playerID, const std::string &commandLine)
+{
+    std::vector<std::string> words;
+    size_t start = commandLine.find_first_not_of(" /");
+    while (start != std::string::npos)
+    {
+        size_t end = commandLine.find(' ', start);
+        words.push_back(commandLine.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        start = commandLine.find_first_not_of(' ', end == std::string::npos ? commandLine.size() : end);
+    }
+
+    if (words.empty() || commands.find(words[0]) == commands.end())
+        return false;
+
+    bz_APIStringList params;
+    for (size_t i = 1; i < words.size(); ++i)
+        params.push_back(words[i]);
+
+    std::string message = commandLine.substr(std::min(commandLine.size(), commandLine.find(words[0]) + words[0].size()));
+    return commands[words[0]]->SlashCommand(playerID, words[0], message, &params);
+}
+
+static MockCall* record(MockCallType type, int playerID)
+{
+    MockServer &server = mockServer();
+    ++server.callCounts[type];
+    if (!server.recordCalls)
+        return NULL;
+
+    MockCall call = {};
+    call.type = type;
+    call.time = server.currentTime;
+    call.playerID = playerID;
+    server.calls.push_back(call);
+    return &server.calls.back();
+}
+
+bool bz_Plugin::Register(bz_eEventType eventType)
+{
+    MockServer &server = mockServer();
+    if (eventType <= bz_eNullEvent || eventType >= bz_eLastEvent)
+        return false;
+
+    server.plugin = this;
+    server.registered[eventType] = true;
+    return true;
+}
+
+bool bz_Plugin::Remove(bz_eEventType eventType)
+{
+    MockServer &server = mockServer();
+    if (eventType <= bz_eNullEvent || eventType >= bz_eLastEvent)
+        return false;
+
+    server.registered[eventType] = false;
+    return true;
+}
+
+void bz_Plugin::Flush()
+{
+    MockServer &server = mockServer();
+    std::fill(server.registered, server.registered + bz_eLastEvent, false);
+    if (server.plugin == this)
+        server.plugin = NULL;
+}
+
+// Like bzfs, the message is formatted before anything looks at the level
+void bz_debugMessage(int level, const char* message)
+{
+    MockServer &server = mockServer();
+    MockCall* call = record(CallDebugMessage, BZ_SERVER);
+    if (call != NULL)
+    {
+        call->value = level;
+        call->text = message;
+    }
+
+    if (server.echoDebug && level <= server.debugLevel)
+        fprintf(stderr, "%s\n", message);
+}
+
+void bz_debugMessagef(int level, const char* fmt, ...)
+{
+    char message[2048];
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    bz_debugMessage(level, message);
+}
+
+int bz_getDebugLevel(void)
+{
+    return mockServer().debugLevel;
+}
+
+double bz_getCurrentTime(void)
+{
+    return mockServer().currentTime;
+}
+
+void bz_shutdown(void)
+{
+    mockServer().shutdownRequested = true;
+}
+
+double bz_getBZDBDouble(const char* variable)
+{
+    MockServer &server = mockServer();
+    std::map<std::string, double>::const_iterator it = server.bzdb.find(variable);
+    return it == server.bzdb.end() ? 0.0 : it->second;
+}
+
+// bzfs tells the plugins about every change, including their own
+static bool updateBZDB(const char* variable, double value)
+{
+    MockServer &server = mockServer();
+    MockCall* call = record(CallUpdateBZDB, BZ_SERVER);
+    if (call != NULL)
+    {
+        call->value = value;
+        call->text = variable;
+    }
+
+    server.bzdb[variable] = value;
+
+    char text[64];
+    snprintf(text, sizeof(text), "%f", value);
+
+    bz_BZDBChangeData_V1 change;
+    change.eventTime = server.currentTime;
+    change.key = variable;
+    change.value = text;
+    server.dispatch(change);
+    return true;
+}
+
+bool bz_updateBZDBDouble(const char* variable, double value, int /*perms*/, bool /*persistent*/)
+{
+    return updateBZDB(variable, value);
+}
+
+bool bz_updateBZDBBool(const char* variable, bool value, int /*perms*/, bool /*persistent*/)
+{
+    return updateBZDB(variable, value ? 1.0 : 0.0);
+}
+
+uint32_t bz_fireServerShot(const char* shotType, float origin[3], float vector[3], bz_eTeamType color, int targetPlayerId)
+{
+    MockServer &server = mockServer();
+    MockCall* call = record(CallFireServerShot, targetPlayerId);
+    if (call != NULL)
+    {
+        std::copy(origin, origin + 3, call->pos);
+        std::copy(vector, vector + 3, call->dir);
+        call->value = color;
+        call->text = shotType;
+    }
+
+    return server.nextShotID++;
+}
+
+bool bz_setPlayerSpawnable(int playerID, bool spawn)
+{
+    MockServer &server = mockServer();
+    MockCall* call = record(CallSetPlayerSpawnable, playerID);
+    if (call != NULL)
+        call->flag = spawn;
+
+    std::map<int, MockPlayer>::iterator player = server.players.find(playerID);
+    if (player == server.players.end())
+        return false;
+
+    player->second.spawnable = spawn;
+    return true;
+}
+
+bool bz_killPlayer(int playerID, bool spawnOnBase, int killerID, const char* flagID)
+{
+    MockServer &server = mockServer();
+    MockCall* call = record(CallKillPlayer, playerID);
+    if (call != NULL)
+    {
+        call->flag = spawnOnBase;
+        call->value = killerID;
+        call->text = flagID != NULL ? flagID : "";
+    }
+
+    return server.players.find(playerID) != server.players.end();
+}
+
+bool bz_givePlayerFlag(int playerID, const char* flagType, bool force)
+{
+    MockServer &server = mockServer();
+    MockCall* call = record(CallGivePlayerFlag, playerID);
+    if (call != NULL)
+    {
+        call->flag = force;
+        call->text = flagType;
+    }
+
+    return server.players.find(playerID) != server.players.end();
+}
+
+const char* bz_getPlayerCallsign(int playerID)
+{
+    MockServer &server = mockServer();
+    std::map<int, MockPlayer>::const_iterator player = server.players.find(playerID);
+    return player == server.players.end() ? NULL : player->second.callsign.c_str();
+}
+
+bz_eTeamType bz_getPlayerTeam(int playerID)
+{
+    MockServer &server = mockServer();
+    std::map<int, MockPlayer>::const_iterator player = server.players.find(playerID);
+    return player == server.players.end() ? eNoTeam : player->second.team;
+}
+
+// The console and everyone in the harness is an admin
+bool bz_hasPerm(int /*playerID*/, const char* /*perm*/)
+{
+    return true;
+}
+
+bool bz_sendTextMessage(int from, int to, const char* message)
+{
+    MockCall* call = record(CallSendTextMessage, to);
+    if (call != NULL)
+    {
+        call->value = from;
+        call->text = message;
+    }
+
+    if (mockServer().echoDebug)
+        fprintf(stderr, "[to %d] %s\n", to, message);
+    return true;
+}
+
+bool bz_sendTextMessagef(int from, int to, const char* fmt, ...)
+{
+    char message[2048];
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    return bz_sendTextMessage(from, to, message);
+}
+
+bool bz_registerCustomSlashCommand(const char* command, bz_CustomSlashCommandHandler* handler)
+{
+    if (command == NULL || handler == NULL)
+        return false;
+
+    mockServer().commands[command] = handler;
+    return true;
+}
+
+bool bz_removeCustomSlashCommand(const char* command)
+{
+    return command != NULL && mockServer().commands.erase(command) > 0;
+}
+
+bz_APIWorldObjectList* bz_getWorldObjectList(void)
+{
+    MockServer &server = mockServer();
+    bz_APIWorldObjectList* list = new bz_APIWorldObjectList;
+    for (size_t i = 0; i < server.world.size(); ++i)
+        list->objects.push_back(&server.world[i]);
+    return list;
+}
+
+void bz_releaseWorldObjectList(bz_APIWorldObjectList* list)
+{
+    delete list;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
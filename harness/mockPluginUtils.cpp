@@ -0,0 +1,196 @@
+// stagedSceneGenerator
+// The stand-in plugin_utils. PluginConfig reads files the same way as the bzfs one: sections and keys are
+// lowercased, values are trimmed, and lines starting with # or ; are comments. See harness/README.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "plugin_utils.h"
+#include "bzfsAPI.h"
+
+#include <ctype.h>
+#include <fstream>
+
+std::string makelower(const char* s)
+{
+    std::string lower(s != NULL ? s : "");
+    for (size_t i = 0; i < lower.size(); ++i)
+        lower[i] = (char)tolower((unsigned char)lower[i]);
+    return lower;
+}
+
+std::string makeupper(const char* s)
+{
+    std::string upper(s != NULL ? s : "");
+    for (size_t i = 0; i < upper.size(); ++i)
+        upper[i] = (char)toupper((unsigned char)upper[i]);
+    return upper;
+}
+
+std::vector<std::string> tokenize(const std::string &in, const std::string &delims, const int maxTokens, const bool useQuotes)
+{
+    std::vector<std::string> tokens;
+    size_t pos = in.find_first_not_of(delims);
+
+    while (pos != std::string::npos)
+    {
+        // The last token gets the rest of the string
+        if (maxTokens > 0 && (int)tokens.size() == maxTokens - 1)
+        {
+            tokens.push_back(in.substr(pos));
+            break;
+        }
+
+        if (useQuotes && in[pos] == '"')
+        {
+            size_t close = in.find('"', pos + 1);
+            tokens.push_back(in.substr(pos + 1, close == std::string::npos ? std::string::npos : close - pos - 1));
+            pos = close == std::string::npos ? close : in.find_first_not_of(delims, close + 1);
+            continue;
+        }
+
+        size_t end = in.find_first_of(delims, pos);
+        tokens.push_back(in.substr(pos, end == std::string::npos ? std::string::npos : end - pos));
+        pos = end == std::string::npos ? end : in.find_first_not_of(delims, end);
+    }
+
+    return tokens;
+}
+
+static const char* whitespace = " \t\r";
+
+static std::string trim(const std::string &s)
+{
+    size_t start = s.find_first_not_of(whitespace);
+    if (start == std::string::npos)
+        return "";
+    return s.substr(start, s.find_last_not_of(whitespace) - start + 1);
+}
+
+PluginConfig::PluginConfig() : errors(0)
+{
+}
+
+PluginConfig::PluginConfig(const std::string &filename) : errors(0)
+{
+    read(filename);
+}
+
+void PluginConfig::read(const char* filename)
+{
+    configFilename = filename != NULL ? filename : "";
+    parse();
+}
+
+void PluginConfig::read(const std::string &filename)
+{
+    read(filename.c_str());
+}
+
+void PluginConfig::parse()
+{
+    errors = 0;
+    sections.clear();
+
+    std::ifstream file(configFilename.c_str());
+    if (!file)
+    {
+        bz_debugMessagef(1, "PluginConfig: Can't open configuration file: %s", configFilename.c_str());
+        ++errors;
+        return;
+    }
+
+    std::string line, section;
+    while (std::getline(file, line))
+    {
+        line = trim(line);
+        if (line.empty() || line[0] == '#' || line[0] == ';')
+            continue;
+
+        if (line[0] == '[')
+        {
+            size_t end = line.find(']');
+            if (end == std::string::npos)
+            {
+                bz_debugMessagef(1, "PluginConfig: Malformed section header: %s", line.c_str());
+                ++errors;
+                continue;
+            }
+            section = makelower(line.substr(1, end - 1).c_str());
+            sections[section];
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos)
+        {
+            bz_debugMessagef(1, "PluginConfig: Malformed line: %s", line.c_str());
+            ++errors;
+            continue;
+        }
+
+        sections[section][makelower(trim(line.substr(0, equals)).c_str())] = trim(line.substr(equals + 1));
+    }
+}
+
+std::string PluginConfig::item(const std::string &section, const std::string &key)
+{
+    std::map<std::string, std::map<std::string, std::string> >::const_iterator s = sections.find(makelower(section.c_str()));
+    if (s == sections.end())
+        return "";
+
+    std::map<std::string, std::string>::const_iterator k = s->second.find(makelower(key.c_str()));
+    return k == s->second.end() ? "" : k->second;
+}
+
+std::vector<std::pair<std::string, std::string> > PluginConfig::getSectionItems(const std::string &section)
+{
+    std::vector<std::pair<std::string, std::string> > items;
+    std::map<std::string, std::map<std::string, std::string> >::const_iterator s = sections.find(makelower(section.c_str()));
+    if (s != sections.end())
+        items.assign(s->second.begin(), s->second.end());
+    return items;
+}
+
+std::vector<std::string> PluginConfig::getSections()
+{
+    std::vector<std::string> names;
+    for (std::map<std::string, std::map<std::string, std::string> >::const_iterator s = sections.begin(); s != sections.end(); ++s)
+        names.push_back(s->first);
+    return names;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,126 @@
+// stagedSceneGenerator
+// What the stand-in bzfs API remembers about the calls the plugin makes, so a harness can drive the plugin
+// and check or count what it did. See harness/README.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#ifndef MOCK_SERVER_H
+#define MOCK_SERVER_H
+
+#include "bzfsAPI.h"
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum MockCallType {
+    CallFireServerShot,
+    CallUpdateBZDB,
+    CallSetPlayerSpawnable,
+    CallKillPlayer,
+    CallGivePlayerFlag,
+    CallSendTextMessage,
+    CallDebugMessage,
+    CallTypeCount
+};
+
+// One call into the API. Which fields mean anything depends on the type.
+struct MockCall
+{
+    MockCallType type;
+    double time;
+    int playerID;
+    bool flag;
+    double value;
+    float pos[3];
+    float dir[3];
+    std::string text;
+};
+
+struct MockPlayer
+{
+    std::string callsign;
+    bz_eTeamType team;
+    bool spawnable;
+};
+
+class MockServer
+{
+public:
+    MockServer();
+
+    // Forget everything, including the plugin's event registrations
+    void reset();
+
+    // Hand an event to the plugin the way bzfs does, but only if the plugin registered for it
+    bool dispatch(bz_EventData &eventData);
+
+    // Run a slash command as the given player
+    bool command(int playerID, const std::string &commandLine);
+
+    void clearCalls();
+
+    double currentTime = 0.0;
+    int debugLevel = 0;
+
+    // Print the debug messages that pass the debug level to stderr
+    bool echoDebug = false;
+
+    // Keep every call in calls, not just the counts. Turn this off to benchmark the plugin and not the harness.
+    bool recordCalls = true;
+
+    bool shutdownRequested = false;
+
+    bz_Plugin* plugin = NULL;
+    bool registered[bz_eLastEvent] = {};
+    std::map<std::string, bz_CustomSlashCommandHandler*> commands;
+
+    std::map<std::string, double> bzdb;
+    std::map<int, MockPlayer> players;
+    std::vector<bz_APISolidWorldObject_V1> world;
+
+    uint64_t callCounts[CallTypeCount] = {};
+    std::vector<MockCall> calls;
+    uint32_t nextShotID = 1;
+};
+
+MockServer& mockServer();
+
+#endif // MOCK_SERVER_H
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
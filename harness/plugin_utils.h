@@ -0,0 +1,77 @@
+// stagedSceneGenerator
+// A stand-in for the bzfs plugin_utils library, with the same config file rules. See harness/README.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#ifndef PLUGIN_UTILS_H
+#define PLUGIN_UTILS_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+std::string makelower(const char* s);
+std::string makeupper(const char* s);
+
+std::vector<std::string> tokenize(const std::string &in, const std::string &delims, const int maxTokens, const bool useQuotes);
+
+class PluginConfig
+{
+public:
+    PluginConfig();
+    PluginConfig(const std::string &filename);
+
+    void read(const char* filename);
+    void read(const std::string &filename);
+
+    std::string item(const std::string &section, const std::string &key);
+    std::vector<std::pair<std::string, std::string> > getSectionItems(const std::string &section);
+    std::vector<std::string> getSections();
+
+    unsigned int errors;
+
+private:
+    void parse();
+
+    std::string configFilename;
+    std::map<std::string, std::map<std::string, std::string> > sections;
+};
+
+#endif // PLUGIN_UTILS_H
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,262 @@
+// stagedSceneGenerator
+// Drives the plugin through the stand-in bzfs API with synthetic join, update, die and tick streams and reports
+// how fast it handles them. See harness/README.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "bzfsAPI.h"
+#include "mockServer.h"
+
+#include <chrono>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+extern "C" bz_Plugin* bz_GetPlugin(void);
+extern "C" void bz_FreePlugin(bz_Plugin* plugin);
+
+// Roughly how many events to send in the update and tick streams, so the small scenes run long enough to time
+static const int UpdateEvents = 200000;
+static const int TickEvents = 20000;
+static const double TickInterval = 0.01;
+
+struct StreamResult
+{
+    const char* name;
+    long events;
+    double seconds;
+};
+
+static const char* configFile = "stagedSceneBench.cfg";
+
+// Half tanks and half shots, laid out on a grid so nothing overlaps
+static bool writeScene(int entities)
+{
+    std::ofstream out(configFile);
+    if (!out)
+        return false;
+
+    out << "[Main]\nMode = static1\nSpawnDelay = 1\nValidate = off\n";
+
+    const int tanks = (entities + 1) / 2, shots = entities - tanks;
+    const char* teams[] = { "red", "green", "blue", "purple" };
+    for (int i = 0; i < tanks; ++i)
+        out << "[Tank" << i << "]\ntype = tank\nteam = " << teams[i % 4] << "\npos = " << (i % 100) * 20 << " "
+            << (i / 100) * 20 << " 0\nrot = 90\n";
+    for (int i = 0; i < shots; ++i)
+        out << "[Shot" << i << "]\ntype = shot\nteam = " << teams[i % 4] << "\npos = " << (i % 100) * 20 << " "
+            << -20 - (i / 100) * 20 << " 1.57\nrot = 90\n";
+
+    return (bool)out;
+}
+
+static void advance(MockServer &server, bz_EventData &event, double seconds)
+{
+    server.currentTime += seconds;
+    event.eventTime = server.currentTime;
+}
+
+static bool runScene(int entities, int debugLevel, std::vector<StreamResult> &results)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    MockServer &server = mockServer();
+    server.reset();
+    server.recordCalls = false;
+
+    // The stand-in formats every message like bzfs does, whether or not the level will show it
+    server.debugLevel = debugLevel;
+
+    if (!writeScene(entities))
+    {
+        fprintf(stderr, "Unable to write %s\n", configFile);
+        return false;
+    }
+
+    bz_Plugin* plugin = bz_GetPlugin();
+    plugin->Init(configFile);
+    remove(configFile);
+    if (server.shutdownRequested)
+    {
+        fprintf(stderr, "The plugin didn't load the %d entity scene\n", entities);
+        bz_FreePlugin(plugin);
+        return false;
+    }
+
+    const int tanks = (entities + 1) / 2;
+    for (int id = 0; id < tanks; ++id)
+        server.players[id] = MockPlayer{ "bot" + std::to_string(id), eRogueTeam, true };
+
+    // Join: pick a team, pick a spawn position and spawn, for every tank
+    StreamResult join = { "join", 0, 0.0 };
+    Clock::time_point started = Clock::now();
+    for (int id = 0; id < tanks; ++id)
+    {
+        bz_GetAutoTeamEventData_V1 team;
+        team.playerID = id;
+        team.team = eRogueTeam;
+        advance(server, team, 0.0);
+        server.dispatch(team);
+        server.players[id].team = team.team;
+
+        bz_GetPlayerSpawnPosEventData_V1 spawnPos;
+        spawnPos.playerID = id;
+        spawnPos.team = team.team;
+        advance(server, spawnPos, 0.0);
+        server.dispatch(spawnPos);
+
+        bz_PlayerSpawnEventData_V1 spawn;
+        spawn.playerID = id;
+        spawn.team = team.team;
+        std::copy(spawnPos.pos, spawnPos.pos + 3, spawn.state.pos);
+        advance(server, spawn, 0.0);
+        server.dispatch(spawn);
+        join.events += 3;
+    }
+    join.seconds = std::chrono::duration<double>(Clock::now() - started).count();
+    results.push_back(join);
+
+    // Update: every tank reports that it is still sitting where it spawned
+    std::vector<bz_PlayerUpdateEventData_V1> updates(tanks);
+    for (int id = 0; id < tanks; ++id)
+    {
+        updates[id].playerID = id;
+        updates[id].state.status = eAlive;
+        updates[id].state.pos[0] = (id % 100) * 20.0f;
+        updates[id].state.pos[1] = (id / 100) * 20.0f;
+        updates[id].state.pos[2] = 0.01f;
+        updates[id].lastState = updates[id].state;
+    }
+
+    StreamResult update = { "update", 0, 0.0 };
+    const int rounds = std::max(1, UpdateEvents / tanks);
+    started = Clock::now();
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (int id = 0; id < tanks; ++id)
+        {
+            advance(server, updates[id], 0.0);
+            server.dispatch(updates[id]);
+        }
+        update.events += tanks;
+    }
+    update.seconds = std::chrono::duration<double>(Clock::now() - started).count();
+    results.push_back(update);
+
+    // Die: every tank is shot
+    StreamResult die = { "die", 0, 0.0 };
+    started = Clock::now();
+    for (int id = 0; id < tanks; ++id)
+    {
+        bz_PlayerDieEventData_V2 death;
+        death.playerID = id;
+        death.team = server.players[id].team;
+        death.state = updates[id].state;
+        advance(server, death, 0.0);
+        server.dispatch(death);
+        ++die.events;
+    }
+    die.seconds = std::chrono::duration<double>(Clock::now() - started).count();
+    results.push_back(die);
+
+    // Tick: run the server clock forward through the respawns and volleys
+    StreamResult tick = { "tick", 0, 0.0 };
+    bz_TickEventData_V1 tickEvent;
+    started = Clock::now();
+    for (int i = 0; i < TickEvents; ++i)
+    {
+        advance(server, tickEvent, TickInterval);
+        server.dispatch(tickEvent);
+        ++tick.events;
+    }
+    tick.seconds = std::chrono::duration<double>(Clock::now() - started).count();
+    results.push_back(tick);
+
+    fprintf(stderr, "%6d entities: %llu shots fired, %llu BZDB writes, %llu spawnable changes\n", entities,
+        (unsigned long long)server.callCounts[CallFireServerShot], (unsigned long long)server.callCounts[CallUpdateBZDB],
+        (unsigned long long)server.callCounts[CallSetPlayerSpawnable]);
+
+    plugin->Cleanup();
+    bz_FreePlugin(plugin);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<int> sizes;
+    int debugLevel = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        // -d, -dd and so on raise the debug level the same way they do for bzfs
+        if (argv[i][0] == '-' && argv[i][1] == 'd' && strspn(argv[i] + 1, "d") == strlen(argv[i] + 1))
+        {
+            debugLevel += (int)strlen(argv[i] + 1);
+            continue;
+        }
+
+        int entities = atoi(argv[i]);
+        if (entities < 1)
+        {
+            fprintf(stderr, "Usage: %s [-d...] [entities ...]\n", argv[0]);
+            return 1;
+        }
+        sizes.push_back(entities);
+    }
+    if (sizes.empty())
+        sizes = { 10, 100, 1000, 10000 };
+
+    printf("%8s %-8s %10s %14s %12s\n", "entities", "stream", "events", "events/sec", "ns/event");
+    for (int entities : sizes)
+    {
+        std::vector<StreamResult> results;
+        if (!runScene(entities, debugLevel, results))
+            return 1;
+
+        for (const StreamResult &result : results)
+        {
+            printf("%8d %-8s %10ld %14.0f %12.1f\n", entities, result.name, result.events,
+                result.events / result.seconds, result.seconds * 1.0e9 / result.events);
+        }
+    }
+
+    return 0;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,295 @@
+// stagedSceneGenerator
+// Times the streaming config parser against the PluginConfig one on generated configs of increasing size, and
+// checks that both give the same scene. See harness/README.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "bzfsAPI.h"
+#include "mockServer.h"
+#include "stagedScene.h"
+
+#include <chrono>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+static const char* configFile = "stagedSceneParseBench.cfg";
+static const char* splitFile = "stagedSceneParseBench.split.cfg";
+
+// The same config split over this many files, which the split config includes
+static const int SplitParts = 8;
+
+static std::string partFile(int part)
+{
+    return "stagedSceneParseBench.part" + std::to_string(part) + ".cfg";
+}
+
+// Tanks and shots with a mix of options, in an order that isn't sorted by name, with comments, odd spacing and
+// mixed case keys. Every thousandth section is a small formation, and another is a group that some of the tanks and
+// shots are in. With more than one part, the sections are split
+// into that many part files and the config only includes them.
+static bool writeConfig(const char* fileName, int sections, int parts)
+{
+    std::ofstream root(fileName);
+    if (!root)
+        return false;
+
+    std::ofstream part;
+    std::ostream* current = &root;
+    if (parts > 1)
+        root << "include = stagedSceneParseBench.part*.cfg\n";
+
+    const char* teams[] = { "red", "Green", "blue", "PURPLE", "rogue" };
+    const char* flags[] = { "", "L", "th", "GM", "SW" };
+    uint32_t random = 12345;
+    auto next = [&random]() {
+        random = random * 1664525u + 1013904223u;
+        return random >> 8;
+    };
+
+    *current << "# Generated by stagedSceneParseBench\n";
+    for (int i = 0; i < sections; ++i)
+    {
+        if (parts > 1 && i % ((sections + parts - 1) / parts) == 0)
+        {
+            part.close();
+            part.open(partFile(i / ((sections + parts - 1) / parts)).c_str());
+            if (!part)
+                return false;
+            current = &part;
+        }
+        std::ostream &out = *current;
+
+        if (i == sections / 2)
+            out << "[Main]\nMode = static2\nShotDelay = 0.5\nSpawnDelay=2\n  Refire = Continuous\nMaxShots = 200\n";
+
+        if (i % 1000 == 999)
+        {
+            out << "[Formation" << i << "]\ntype = formation\nof = " << (i % 2000 == 999 ? "tank" : "shot")
+                << "\nlayout = ring\ncount = 10\nfacing = inward\njitter = 1\nseed = " << i << "\nteam = red\n";
+            continue;
+        }
+        if (i % 1000 == 499)
+        {
+            out << "[Vignette" << i << "]\ntype = Group\nShotDelay = 1\nSpawnDelay = 0." << i % 10 << "\nenabled = "
+                << (i % 2000 == 499 ? "true" : "FALSE") << "\n";
+            continue;
+        }
+
+        const int x = (int)(next() % 800) - 400, y = (int)(next() % 800) - 400;
+        if (next() % 2 == 0)
+        {
+            out << "[Tank" << i << "]\nType = tank\n  team =\t" << teams[next() % 5] << "\npos = " << x << " " << y
+                << " 0\nROT = " << next() % 360 << "\n";
+            if (next() % 10 == 0)
+                out << "random = True\n";
+            if (sections > 499 && next() % 8 == 0)
+                out << "Group = vignette499\n";
+        }
+        else
+        {
+            const char* flag = flags[next() % 5];
+            out << "; a shot\n[Shot" << i << "]\ntype = Shot\nteam = " << teams[next() % 5] << "\nflag = " << flag
+                << "\npos = " << x << " " << y << " 1.57\nrot = " << next() % 360 << "\nelev = " << next() % 10 << "\n";
+            if (flag[0] == 'G')
+                out << "target = tank" << next() % sections << "\n";
+            if (next() % 4 == 0)
+                out << "age = 0." << next() % 10 << "\n";
+            if (sections > 1499 && next() % 8 == 0)
+                out << "group = VIGNETTE1499\n";
+        }
+    }
+
+    return (bool)root && (parts == 1 || (bool)part);
+}
+
+template <typename T>
+static bool sameArray(const T* a, const T* b, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!(a[i] == b[i]))
+            return false;
+    }
+    return true;
+}
+
+static bool sameScene(const StagedScene &a, const StagedScene &b)
+{
+    if (a.mode != b.mode || a.refireMode != b.refireMode || a.maxShots != b.maxShots || a.validation != b.validation
+        || a.groups.size() != b.groups.size() || a.shotSpeed != b.shotSpeed
+        || a.driftTolerance != b.driftTolerance || a.readyFile != b.readyFile || a.statsFile != b.statsFile
+        || a.recordFile != b.recordFile
+        || a.statsInterval != b.statsInterval || a.shotFlags != b.shotFlags)
+        return false;
+
+    if (a.stagedPlayers.size() != b.stagedPlayers.size() || a.stagedShots.size() != b.stagedShots.size())
+        return false;
+
+    for (size_t i = 0; i < a.groups.size(); ++i)
+    {
+        const StagedGroup &g = a.groups[i], &h = b.groups[i];
+        if (g.name != h.name || g.delayBetweenShots != h.delayBetweenShots || g.spawnDelay != h.spawnDelay
+            || g.enabled != h.enabled)
+            return false;
+    }
+
+    for (size_t i = 0; i < a.stagedPlayers.size(); ++i)
+    {
+        const StagedPlayer &p = a.stagedPlayers[i], &q = b.stagedPlayers[i];
+        if (p.team != q.team || p.random != q.random || !sameArray(p.pos, q.pos, 3) || p.rot != q.rot
+            || p.flag != q.flag || p.sectionName != q.sectionName || p.group != q.group)
+            return false;
+    }
+
+    for (size_t i = 0; i < a.stagedShots.size(); ++i)
+    {
+        const StagedShot &s = a.stagedShots[i], &t = b.stagedShots[i];
+        if (s.team != t.team || !sameArray(s.pos, t.pos, 3) || !sameArray(s.dir, t.dir, 3) || s.flag != t.flag
+            || s.speedClass != t.speedClass || s.targetPlayerSectionName != t.targetPlayerSectionName
+            || s.age != t.age || s.distance != t.distance || s.bounces != t.bounces || s.group != t.group)
+            return false;
+    }
+
+    return a.shotTable.pos == b.shotTable.pos && a.shotTable.dir == b.shotTable.dir
+        && a.shotTable.team == b.shotTable.team && a.shotTable.flag == b.shotTable.flag
+        && a.shotTable.target == b.shotTable.target && a.shotTable.group == b.shotTable.group
+        && sameArray(a.shotTable.classStart, b.shotTable.classStart, ShotSpeedClassCount + 1);
+}
+
+// Every file in harness/includes starts with an include before its first section, and they nest more than one deep
+static bool checkIncludes()
+{
+    const std::string topFile = std::string(HARNESS_DIR) + "/includes/top.cfg";
+
+    mockServer().echoDebug = true;
+    StagedScene scene;
+    bool parsed = scene.readConfig(topFile.c_str());
+    mockServer().echoDebug = false;
+
+    if (!parsed || scene.mode != ModeStatic2 || scene.stagedPlayers.size() != 2 || scene.stagedShots.size() != 2)
+    {
+        fprintf(stderr, "%s didn't give the scene it describes\n", topFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+// The fastest of a few runs, in seconds
+static double timeParser(bool (StagedScene::*parse)(const char*), const char* fileName, int repeats, StagedScene &result)
+{
+    double best = 0.0;
+    for (int i = 0; i < repeats; ++i)
+    {
+        StagedScene scene;
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        bool parsed = (scene.*parse)(fileName);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        if (!parsed)
+            return -1.0;
+        if (i == 0 || seconds < best)
+            best = seconds;
+        if (i == repeats - 1)
+            result = scene;
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; ++i)
+    {
+        int sections = atoi(argv[i]);
+        if (sections < 1)
+        {
+            fprintf(stderr, "Usage: %s [sections ...]\n", argv[0]);
+            return 1;
+        }
+        sizes.push_back(sections);
+    }
+    if (sizes.empty())
+        sizes = { 100, 1000, 10000, 50000 };
+
+    if (!checkIncludes())
+        return 1;
+
+    printf("%8s %10s %14s %14s %14s %8s %14s\n", "sections", "KB", "pluginconfig", "streaming", "sections/sec",
+        "speedup", "8 includes");
+    for (int sections : sizes)
+    {
+        if (!writeConfig(configFile, sections, 1) || !writeConfig(splitFile, sections, SplitParts))
+        {
+            fprintf(stderr, "Unable to write the configs\n");
+            return 1;
+        }
+
+        std::ifstream in(configFile, std::ios::binary | std::ios::ate);
+        const double kilobytes = in.tellg() / 1024.0;
+        in.close();
+
+        const int repeats = sections >= 10000 ? 3 : 10;
+        StagedScene before, after, split;
+        double pluginConfig = timeParser(&StagedScene::readPluginConfig, configFile, repeats, before);
+        double streaming = timeParser(&StagedScene::readConfig, configFile, repeats, after);
+        double included = timeParser(&StagedScene::readConfig, splitFile, repeats, split);
+        remove(configFile);
+        remove(splitFile);
+        for (int part = 0; part < SplitParts; ++part)
+            remove(partFile(part).c_str());
+
+        if (pluginConfig < 0.0 || streaming < 0.0 || included < 0.0)
+        {
+            fprintf(stderr, "The %d section config didn't parse\n", sections);
+            return 1;
+        }
+        if (!sameScene(before, after) || !sameScene(after, split))
+        {
+            fprintf(stderr, "The parsers disagree about the %d section config\n", sections);
+            return 1;
+        }
+
+        printf("%8d %10.0f %11.2f ms %11.2f ms %14.0f %7.1fx %11.2f ms\n", sections, kilobytes, pluginConfig * 1000.0,
+            streaming * 1000.0, sections / streaming, pluginConfig / streaming, included * 1000.0);
+    }
+
+    return 0;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,366 @@
+// stagedSceneGenerator
+// Replays a recording made with the RecordFile option through the plugin, with the same event times, checks that
+// the plugin picks the same teams, spawn positions and shots, and reports how long each kind of event took. See
+// harness/README.txt
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "bzfsAPI.h"
+#include "mockServer.h"
+#include "stagedRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+extern "C" bz_Plugin* bz_GetPlugin(void);
+extern "C" void bz_FreePlugin(bz_Plugin* plugin);
+
+// Positions and directions are allowed to be off by this much, for a plugin built with a different compiler or
+// floating point settings than the harness
+static const float Tolerance = 1.0e-4f;
+
+// Only the first few differences are printed
+static const unsigned int MaxReported = 10;
+
+static const char* const RecordNames[RecordTypeCount] = {
+    "team", "assigned", "spawnpos", "placed", "spawn", "die", "update", "part", "tick", "bzdb", "command", "shot"
+};
+
+struct Replay
+{
+    unsigned long long records = 0;
+    unsigned long long checks = 0;
+    unsigned long long differences = 0;
+
+    // How many of each kind of event were sent and how long the plugin took with them
+    unsigned long long counts[RecordTypeCount] = {};
+    double seconds[RecordTypeCount] = {};
+
+    // The shots the plugin fired that haven't been matched up with a recorded shot yet
+    std::deque<MockCall> fired;
+
+    bz_GetAutoTeamEventData_V1 lastTeam;
+    bz_GetPlayerSpawnPosEventData_V1 lastSpawnPos;
+
+    void differ(const SceneRecord &record, const char* fmt, ...)
+#ifdef __GNUC__
+        __attribute__((format(printf, 3, 4)))
+#endif
+        ;
+};
+
+void Replay::differ(const SceneRecord &record, const char* fmt, ...)
+{
+    if (++differences > MaxReported)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "Record %llu at %.3f (%s): ", records, record.time, RecordNames[record.type]);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+static bool near(const float* a, const float* b, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (fabsf(a[i] - b[i]) > Tolerance)
+            return false;
+    }
+    return true;
+}
+
+static void setState(bz_PlayerUpdateState &state, const SceneRecord &record)
+{
+    state.status = (bz_ePlayerStatus)record.status;
+    std::copy(record.pos, record.pos + 3, state.pos);
+    std::copy(record.vec, record.vec + 3, state.velocity);
+    state.rotation = record.rot;
+}
+
+// Sends one event to the plugin at the recorded time and keeps the shots it fired
+static void send(Replay &replay, bz_EventData &eventData, const SceneRecord &record)
+{
+    MockServer &server = mockServer();
+    server.currentTime = record.time;
+    eventData.eventTime = record.time;
+    server.clearCalls();
+
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    server.dispatch(eventData);
+    replay.seconds[record.type] += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    ++replay.counts[record.type];
+
+    for (const MockCall &call : server.calls)
+    {
+        if (call.type == CallFireServerShot)
+            replay.fired.push_back(call);
+    }
+}
+
+static void replayRecord(Replay &replay, const SceneRecord &record)
+{
+    MockServer &server = mockServer();
+
+    switch (record.type)
+    {
+    case RecordAutoTeam:
+    {
+        bz_GetAutoTeamEventData_V1 &data = replay.lastTeam;
+        data = bz_GetAutoTeamEventData_V1();
+        data.playerID = record.playerID;
+        data.team = (bz_eTeamType)record.team;
+        send(replay, data, record);
+        server.players[record.playerID] = MockPlayer{ "player" + std::to_string(record.playerID), data.team, true };
+        break;
+    }
+
+    case RecordAssignedTeam:
+        ++replay.checks;
+        if (replay.lastTeam.playerID != record.playerID || replay.lastTeam.team != record.team)
+            replay.differ(record, "player %d was put on team %d instead of %d", record.playerID, replay.lastTeam.team,
+                          record.team);
+        break;
+
+    case RecordSpawnPos:
+    {
+        bz_GetPlayerSpawnPosEventData_V1 &data = replay.lastSpawnPos;
+        data = bz_GetPlayerSpawnPosEventData_V1();
+        data.playerID = record.playerID;
+        data.team = (bz_eTeamType)record.team;
+        send(replay, data, record);
+        break;
+    }
+
+    case RecordSpawnPlaced:
+        ++replay.checks;
+        if (replay.lastSpawnPos.playerID != record.playerID || !near(replay.lastSpawnPos.pos, record.pos, 3)
+            || !near(&replay.lastSpawnPos.rot, &record.rot, 1))
+            replay.differ(record, "player %d spawns at %.3f %.3f %.3f instead of %.3f %.3f %.3f", record.playerID,
+                          replay.lastSpawnPos.pos[0], replay.lastSpawnPos.pos[1], replay.lastSpawnPos.pos[2],
+                          record.pos[0], record.pos[1], record.pos[2]);
+        break;
+
+    case RecordSpawn:
+    {
+        bz_PlayerSpawnEventData_V1 data;
+        data.playerID = record.playerID;
+        data.team = (bz_eTeamType)record.team;
+        data.state.status = eAlive;
+        std::copy(record.pos, record.pos + 3, data.state.pos);
+        data.state.rotation = record.rot;
+        send(replay, data, record);
+        break;
+    }
+
+    case RecordDie:
+    {
+        bz_PlayerDieEventData_V2 data;
+        data.playerID = record.playerID;
+        data.team = (bz_eTeamType)record.team;
+        data.killerID = record.other;
+        data.state.status = eDead;
+        std::copy(record.pos, record.pos + 3, data.state.pos);
+        data.state.rotation = record.rot;
+        send(replay, data, record);
+        break;
+    }
+
+    case RecordUpdate:
+    {
+        bz_PlayerUpdateEventData_V1 data;
+        data.playerID = record.playerID;
+        setState(data.state, record);
+        data.lastState = data.state;
+        data.stateTime = record.time;
+        send(replay, data, record);
+        break;
+    }
+
+    case RecordPart:
+    {
+        bz_PlayerJoinPartEventData_V1 data;
+        data.playerID = record.playerID;
+        send(replay, data, record);
+        server.players.erase(record.playerID);
+        break;
+    }
+
+    case RecordTick:
+    {
+        bz_TickEventData_V1 data;
+        send(replay, data, record);
+        break;
+    }
+
+    case RecordBZDBChange:
+    {
+        // bzfs has already changed the value by the time the plugin hears about it
+        bz_BZDBChangeData_V1 data;
+        data.key = record.text.c_str();
+        data.value = record.value.c_str();
+        server.bzdb[record.text] = atof(record.value.c_str());
+        send(replay, data, record);
+        break;
+    }
+
+    case RecordCommand:
+    {
+        server.currentTime = record.time;
+        server.clearCalls();
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        server.command(record.playerID, record.text);
+        replay.seconds[record.type] +=
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        ++replay.counts[record.type];
+        for (const MockCall &call : server.calls)
+        {
+            if (call.type == CallFireServerShot)
+                replay.fired.push_back(call);
+        }
+        break;
+    }
+
+    case RecordShot:
+    {
+        ++replay.checks;
+        if (replay.fired.empty())
+        {
+            replay.differ(record, "a %s shot from %.3f %.3f %.3f was not fired", record.text.c_str(), record.pos[0],
+                          record.pos[1], record.pos[2]);
+            break;
+        }
+
+        const MockCall &call = replay.fired.front();
+        if (call.text != record.text || call.value != record.team || call.playerID != record.playerID
+            || !near(call.pos, record.pos, 3) || !near(call.dir, record.vec, 3))
+            replay.differ(record, "fired a %s shot from %.3f %.3f %.3f instead of a %s shot from %.3f %.3f %.3f",
+                          call.text.c_str(), call.pos[0], call.pos[1], call.pos[2], record.text.c_str(), record.pos[0],
+                          record.pos[1], record.pos[2]);
+        replay.fired.pop_front();
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s <recording> [<scene>]\n", argv[0]);
+        return 1;
+    }
+
+    // Errors from reading the recording and the scene go through the stand-in bzfs log, so show them
+    MockServer &server = mockServer();
+    server.reset();
+    server.echoDebug = true;
+
+    RecordReader reader;
+    if (!reader.open(argv[1]))
+        return 1;
+
+    // The scene is loaded from where it was on the server unless another copy is given. The replay doesn't record
+    // itself, so the scene's RecordFile is left alone.
+    const std::string sceneFile = argc > 2 ? argv[2] : reader.sceneFile;
+    SceneRecorder::enabled = false;
+
+    server.currentTime = reader.startTime;
+    for (int i = 0; i < ServerValueCount; ++i)
+        server.bzdb[SceneRecorder::serverVariable(i)] = reader.serverValues[i];
+
+    bz_Plugin* plugin = bz_GetPlugin();
+    plugin->Init(sceneFile.c_str());
+    if (server.shutdownRequested)
+    {
+        fprintf(stderr, "The plugin didn't load %s\n", sceneFile.c_str());
+        bz_FreePlugin(plugin);
+        return 1;
+    }
+
+    // The plugin's own messages would bury the differences
+    server.echoDebug = false;
+
+    Replay replay;
+    SceneRecord record;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    while (reader.next(record))
+    {
+        ++replay.records;
+        replayRecord(replay, record);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    for (const MockCall &call : replay.fired)
+    {
+        ++replay.differences;
+        if (replay.differences <= MaxReported)
+            fprintf(stderr, "At the end: fired a %s shot from %.3f %.3f %.3f that wasn't recorded\n", call.text.c_str(),
+                    call.pos[0], call.pos[1], call.pos[2]);
+    }
+
+    if (reader.damaged)
+        fprintf(stderr, "The recording is cut short or damaged after record %llu\n", replay.records);
+
+    printf("%-10s %10s %12s\n", "event", "count", "ns/event");
+    for (int type = 0; type < RecordTypeCount; ++type)
+    {
+        if (replay.counts[type] == 0)
+            continue;
+        printf("%-10s %10llu %12.1f\n", RecordNames[type], replay.counts[type],
+               replay.seconds[type] * 1.0e9 / replay.counts[type]);
+    }
+    printf("Replayed %llu records covering %.1f seconds of the run in %.3f seconds\n", replay.records,
+           record.time - reader.startTime, elapsed);
+    printf("%llu teams, spawn positions and shots checked, %llu differences\n", replay.checks, replay.differences);
+
+    plugin->Cleanup();
+    bz_FreePlugin(plugin);
+    return replay.differences > 0 || reader.damaged ? 1 : 0;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,86 @@
+// stagedSceneGenerator
+// Deferred logging for the event handlers, so messages nobody will see are never
+// formatted and the rest are written out once per tick. See
+// README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "stagedLog.h"
+#include "bzfsAPI.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+void SceneLog::messagef(int messageLevel, const char* fmt, ...)
+{
+    if (!wants(messageLevel))
+        return;
+
+    if (count == Capacity)
+    {
+        ++dropped;
+        return;
+    }
+
+    Entry &entry = entries[(first + count++) % Capacity];
+    entry.level = messageLevel;
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(entry.text, MessageSize, fmt, args);
+    va_end(args);
+}
+
+void SceneLog::flush()
+{
+    for (; count > 0; --count)
+    {
+        const Entry &entry = entries[first];
+        bz_debugMessage(entry.level, entry.text);
+        first = (first + 1) % Capacity;
+    }
+
+    if (dropped > 0)
+    {
+        bz_debugMessagef(0, "WARNING: Dropped %u stagedSceneGenerator log messages", (unsigned)dropped);
+        dropped = 0;
+    }
+
+    setLevel(bz_getDebugLevel());
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,456 @@
+// stagedSceneGenerator
+// Records the events the plugin handles and the shots it fires to a compact
+// binary file, so a run can be replayed against the harness. See
+// README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "stagedRecorder.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string.h>
+
+namespace
+{
+const char RecordingMagic[4] = {'S', 'S', 'G', 'R'};
+const uint32_t RecordingVersion = 1;
+
+// Written in the machine's own byte order, so a recording from a machine with the other order is refused
+const uint32_t RecordingByteOrder = 0x01020304;
+
+struct RecordingHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t headerSize;
+    double startTime;
+    double serverValues[ServerValueCount];
+
+    // The scene file name follows the header
+    uint32_t sceneFileLength;
+    uint32_t reserved;
+};
+
+enum RecordField {
+    FieldPlayer = 1 << 0,
+    FieldTeam = 1 << 1,
+    FieldOther = 1 << 2,
+    FieldStatus = 1 << 3,
+    FieldPos = 1 << 4,
+    FieldVec = 1 << 5,
+    FieldRot = 1 << 6,
+    FieldText = 1 << 7,
+    FieldValue = 1 << 8
+};
+
+// The fields each type of record has, in the order they are written after the type and time
+const uint16_t RecordFields[RecordTypeCount] = {
+    FieldPlayer | FieldTeam,                                    // RecordAutoTeam
+    FieldPlayer | FieldTeam,                                    // RecordAssignedTeam
+    FieldPlayer | FieldTeam,                                    // RecordSpawnPos
+    FieldPlayer | FieldPos | FieldRot,                          // RecordSpawnPlaced
+    FieldPlayer | FieldTeam | FieldPos | FieldRot,              // RecordSpawn
+    FieldPlayer | FieldTeam | FieldOther | FieldPos | FieldRot, // RecordDie
+    FieldPlayer | FieldStatus | FieldPos | FieldVec | FieldRot, // RecordUpdate
+    FieldPlayer,                                                // RecordPart
+    0,                                                          // RecordTick
+    FieldText | FieldValue,                                     // RecordBZDBChange
+    FieldPlayer | FieldText,                                    // RecordCommand
+    FieldPlayer | FieldTeam | FieldPos | FieldVec | FieldText   // RecordShot, with the target as the player
+};
+
+const char* const ServerVariables[ServerValueCount] = {
+    "_shotSpeed", "_laserAdLife", "_thiefAdLife", "_reloadTime", "_explodeTime", "_worldSize", "_rFireAdVel",
+    "_mGunAdVel"
+};
+
+// Strings are written with a one byte length, so longer ones are cut short
+const size_t MaxStringLength = 255;
+}
+
+bool SceneRecorder::enabled = true;
+
+const char* SceneRecorder::serverVariable(int value)
+{
+    return value >= 0 && value < ServerValueCount ? ServerVariables[value] : "";
+}
+
+bool SceneRecorder::open(const std::string &recordFile, const std::string &sceneFile, double startTime,
+                         const double serverValues[ServerValueCount])
+{
+    close();
+
+    file = fopen(recordFile.c_str(), "wb");
+    if (file == NULL)
+        return false;
+
+    fileName = recordFile;
+    buffer.resize(BufferSize);
+    used = 0;
+    lastWrite = startTime;
+    records = 0;
+    bytes = 0;
+
+    RecordingHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RecordingMagic, sizeof(header.magic));
+    header.version = RecordingVersion;
+    header.byteOrder = RecordingByteOrder;
+    header.headerSize = sizeof(RecordingHeader);
+    header.startTime = startTime;
+    std::copy(serverValues, serverValues + ServerValueCount, header.serverValues);
+    header.sceneFileLength = (uint32_t)sceneFile.size();
+
+    put(&header, sizeof(header));
+    put(sceneFile.data(), sceneFile.size());
+    return true;
+}
+
+void SceneRecorder::close()
+{
+    if (file == NULL)
+        return;
+
+    flush();
+    if (fclose(file) != 0)
+        bz_debugMessagef(0, "WARNING: Unable to finish writing the recording %s", fileName.c_str());
+    else
+        bz_debugMessagef(1, "INFO: Recorded %llu events and shots in %.1f KB to %s", (unsigned long long)records,
+                         bytes / 1024.0, fileName.c_str());
+    file = NULL;
+}
+
+void SceneRecorder::event(const bz_EventData* eventData)
+{
+    record.time = eventData->eventTime;
+
+    switch (eventData->eventType)
+    {
+    case bz_eGetAutoTeamEvent:
+    {
+        const bz_GetAutoTeamEventData_V1* data = (const bz_GetAutoTeamEventData_V1*)eventData;
+        record.type = RecordAutoTeam;
+        record.playerID = data->playerID;
+        record.team = data->team;
+        break;
+    }
+
+    case bz_eGetPlayerSpawnPosEvent:
+    {
+        const bz_GetPlayerSpawnPosEventData_V1* data = (const bz_GetPlayerSpawnPosEventData_V1*)eventData;
+        record.type = RecordSpawnPos;
+        record.playerID = data->playerID;
+        record.team = data->team;
+        break;
+    }
+
+    case bz_ePlayerSpawnEvent:
+    {
+        const bz_PlayerSpawnEventData_V1* data = (const bz_PlayerSpawnEventData_V1*)eventData;
+        record.type = RecordSpawn;
+        record.playerID = data->playerID;
+        record.team = data->team;
+        std::copy(data->state.pos, data->state.pos + 3, record.pos);
+        record.rot = data->state.rotation;
+        break;
+    }
+
+    case bz_ePlayerDieEvent:
+    {
+        const bz_PlayerDieEventData_V1* data = (const bz_PlayerDieEventData_V1*)eventData;
+        record.type = RecordDie;
+        record.playerID = data->playerID;
+        record.team = data->team;
+        record.other = data->killerID;
+        std::copy(data->state.pos, data->state.pos + 3, record.pos);
+        record.rot = data->state.rotation;
+        break;
+    }
+
+    case bz_ePlayerUpdateEvent:
+    {
+        const bz_PlayerUpdateEventData_V1* data = (const bz_PlayerUpdateEventData_V1*)eventData;
+        record.type = RecordUpdate;
+        record.playerID = data->playerID;
+        record.status = data->state.status;
+        std::copy(data->state.pos, data->state.pos + 3, record.pos);
+        std::copy(data->state.velocity, data->state.velocity + 3, record.vec);
+        record.rot = data->state.rotation;
+        break;
+    }
+
+    case bz_ePlayerPartEvent:
+        record.type = RecordPart;
+        record.playerID = ((const bz_PlayerJoinPartEventData_V1*)eventData)->playerID;
+        break;
+
+    case bz_eTickEvent:
+        record.type = RecordTick;
+        break;
+
+    case bz_eBZDBChange:
+    {
+        const bz_BZDBChangeData_V1* data = (const bz_BZDBChangeData_V1*)eventData;
+        record.type = RecordBZDBChange;
+        record.text = data->key.c_str();
+        record.value = data->value.c_str();
+        break;
+    }
+
+    default:
+        return;
+    }
+
+    write(record);
+}
+
+void SceneRecorder::result(const bz_EventData* eventData)
+{
+    record.time = eventData->eventTime;
+
+    if (eventData->eventType == bz_eGetAutoTeamEvent)
+    {
+        const bz_GetAutoTeamEventData_V1* data = (const bz_GetAutoTeamEventData_V1*)eventData;
+        record.type = RecordAssignedTeam;
+        record.playerID = data->playerID;
+        record.team = data->team;
+    }
+    else if (eventData->eventType == bz_eGetPlayerSpawnPosEvent)
+    {
+        const bz_GetPlayerSpawnPosEventData_V1* data = (const bz_GetPlayerSpawnPosEventData_V1*)eventData;
+        record.type = RecordSpawnPlaced;
+        record.playerID = data->playerID;
+        std::copy(data->pos, data->pos + 3, record.pos);
+        record.rot = data->rot;
+    }
+    else
+        return;
+
+    write(record);
+}
+
+void SceneRecorder::command(double time, int playerID, const std::string &commandLine)
+{
+    record.type = RecordCommand;
+    record.time = time;
+    record.playerID = playerID;
+    record.text = commandLine;
+    write(record);
+}
+
+void SceneRecorder::shot(double time, const char* flag, const float pos[3], const float dir[3], bz_eTeamType team,
+                         int target)
+{
+    record.type = RecordShot;
+    record.time = time;
+    record.playerID = target;
+    record.team = team;
+    std::copy(pos, pos + 3, record.pos);
+    std::copy(dir, dir + 3, record.vec);
+    record.text = flag;
+    write(record);
+}
+
+void SceneRecorder::tick(double now)
+{
+    if (file == NULL || now - lastWrite < 1.0)
+        return;
+
+    flush();
+    lastWrite = now;
+}
+
+void SceneRecorder::write(const SceneRecord &r)
+{
+    if (file == NULL)
+        return;
+
+    if (used + MaxRecordSize > buffer.size())
+        flush();
+
+    const uint16_t fields = RecordFields[r.type];
+    const uint8_t type = (uint8_t)r.type;
+    put(&type, sizeof(type));
+    put(&r.time, sizeof(r.time));
+    if (fields & FieldPlayer)
+        put(&r.playerID, sizeof(r.playerID));
+    if (fields & FieldTeam)
+        put(&r.team, sizeof(r.team));
+    if (fields & FieldOther)
+        put(&r.other, sizeof(r.other));
+    if (fields & FieldStatus)
+        put(&r.status, sizeof(r.status));
+    if (fields & FieldPos)
+        put(r.pos, sizeof(r.pos));
+    if (fields & FieldVec)
+        put(r.vec, sizeof(r.vec));
+    if (fields & FieldRot)
+        put(&r.rot, sizeof(r.rot));
+    for (int field = FieldText; field <= FieldValue; field <<= 1)
+    {
+        if (!(fields & field))
+            continue;
+
+        const std::string &str = field == FieldText ? r.text : r.value;
+        const uint8_t length = (uint8_t)std::min(str.size(), MaxStringLength);
+        put(&length, sizeof(length));
+        put(str.data(), length);
+    }
+
+    ++records;
+}
+
+void SceneRecorder::put(const void* data, size_t size)
+{
+    // Only the header can be bigger than what is left, and only with a very long scene file name
+    if (used + size > buffer.size())
+        buffer.resize(used + size);
+
+    memcpy(&buffer[used], data, size);
+    used += size;
+}
+
+void SceneRecorder::flush()
+{
+    if (used == 0)
+        return;
+
+    if (fwrite(&buffer[0], 1, used, file) != used)
+        bz_debugMessagef(0, "WARNING: Unable to write to the recording %s", fileName.c_str());
+    bytes += used;
+    used = 0;
+}
+
+bool RecordReader::open(const char* fileName)
+{
+    std::ifstream in(fileName, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!in)
+    {
+        bz_debugMessagef(0, "ERROR: Unable to open the recording %s", fileName);
+        return false;
+    }
+
+    buffer.resize((size_t)in.tellg());
+    in.seekg(0);
+    position = 0;
+    damaged = false;
+
+    RecordingHeader header;
+    if (buffer.size() < sizeof(header) || !in.read(&buffer[0], buffer.size()))
+    {
+        bz_debugMessagef(0, "ERROR: %s is not a recording", fileName);
+        return false;
+    }
+
+    get(&header, sizeof(header));
+    if (memcmp(header.magic, RecordingMagic, sizeof(header.magic)) != 0 || header.headerSize != sizeof(header))
+    {
+        bz_debugMessagef(0, "ERROR: %s is not a recording", fileName);
+        return false;
+    }
+    if (header.version != RecordingVersion || header.byteOrder != RecordingByteOrder)
+    {
+        bz_debugMessagef(0, "ERROR: %s was recorded by a different version of the plugin or on a different platform", fileName);
+        return false;
+    }
+
+    sceneFile.resize(header.sceneFileLength);
+    if (!get(&sceneFile[0], sceneFile.size()))
+    {
+        bz_debugMessagef(0, "ERROR: The recording %s is damaged", fileName);
+        return false;
+    }
+
+    startTime = header.startTime;
+    std::copy(header.serverValues, header.serverValues + ServerValueCount, serverValues);
+    return true;
+}
+
+bool RecordReader::next(SceneRecord &r)
+{
+    uint8_t type;
+    if (position == buffer.size() || !get(&type, sizeof(type)))
+        return false;
+
+    damaged = true;
+    if (type >= RecordTypeCount)
+        return false;
+
+    const uint16_t fields = RecordFields[type];
+    r.type = (RecordType)type;
+    if (!get(&r.time, sizeof(r.time))
+        || ((fields & FieldPlayer) && !get(&r.playerID, sizeof(r.playerID)))
+        || ((fields & FieldTeam) && !get(&r.team, sizeof(r.team)))
+        || ((fields & FieldOther) && !get(&r.other, sizeof(r.other)))
+        || ((fields & FieldStatus) && !get(&r.status, sizeof(r.status)))
+        || ((fields & FieldPos) && !get(r.pos, sizeof(r.pos)))
+        || ((fields & FieldVec) && !get(r.vec, sizeof(r.vec)))
+        || ((fields & FieldRot) && !get(&r.rot, sizeof(r.rot))))
+        return false;
+
+    for (int field = FieldText; field <= FieldValue; field <<= 1)
+    {
+        if (!(fields & field))
+            continue;
+
+        std::string &str = field == FieldText ? r.text : r.value;
+        uint8_t length;
+        if (!get(&length, sizeof(length)))
+            return false;
+        str.resize(length);
+        if (length > 0 && !get(&str[0], length))
+            return false;
+    }
+
+    damaged = false;
+    return true;
+}
+
+bool RecordReader::get(void* data, size_t size)
+{
+    if (size > buffer.size() - position)
+        return false;
+
+    if (size > 0)
+        memcpy(data, &buffer[position], size);
+    position += size;
+    return true;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,184 @@
+// stagedSceneGenerator
+// Records the events the plugin handles and the shots it fires to a compact
+// binary file, so a run can be replayed against the harness. See
+// README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#ifndef STAGED_RECORDER_H
+#define STAGED_RECORDER_H
+
+#include "bzfsAPI.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Each handled event is recorded as it comes in. The team and spawn position the plugin picked and every shot it
+// fired follow the event that caused them, so a replay can check it does the same.
+enum RecordType {
+    RecordAutoTeam,
+    RecordAssignedTeam,
+    RecordSpawnPos,
+    RecordSpawnPlaced,
+    RecordSpawn,
+    RecordDie,
+    RecordUpdate,
+    RecordPart,
+    RecordTick,
+    RecordBZDBChange,
+    RecordCommand,
+    RecordShot,
+    RecordTypeCount
+};
+
+// The BZDB values the plugin reads when it starts, saved so a replay can start the plugin with the same ones
+enum RecordServerValue {
+    ServerShotSpeed,
+    ServerLaserAdLife,
+    ServerThiefAdLife,
+    ServerReloadTime,
+    ServerExplodeTime,
+    ServerWorldSize,
+    ServerRapidFireAdVel,
+    ServerMachineGunAdVel,
+    ServerValueCount
+};
+
+// One record. Each type only writes the fields it uses.
+struct SceneRecord
+{
+    RecordType type = RecordTick;
+    double time = 0.0;
+    int32_t playerID = -1;
+    int32_t team = eNoTeam;
+
+    // The killer of a death
+    int32_t other = -1;
+
+    // The player status of an update
+    int32_t status = 0;
+
+    float pos[3] {0.0f, 0.0f, 0.0f};
+
+    // The velocity of an update or the direction of a shot
+    float vec[3] {0.0f, 0.0f, 0.0f};
+    float rot = 0.0f;
+
+    // The BZDB key, the command line or the shot's flag, and the new BZDB value
+    std::string text;
+    std::string value;
+};
+
+class SceneRecorder
+{
+public:
+    static const char* serverVariable(int value);
+
+    // stagedSceneReplay turns this off, so replaying a scene doesn't write over the scene's own RecordFile
+    static bool enabled;
+
+    bool open(const std::string &fileName, const std::string &sceneFile, double startTime,
+              const double serverValues[ServerValueCount]);
+    void close();
+
+    bool isOpen() const
+    {
+        return file != NULL;
+    }
+
+    // The event as bzfs handed it over, and then what the plugin decided for team and spawn position events
+    void event(const bz_EventData* eventData);
+    void result(const bz_EventData* eventData);
+
+    void command(double time, int playerID, const std::string &commandLine);
+    void shot(double time, const char* flag, const float pos[3], const float dir[3], bz_eTeamType team, int target);
+
+    // Writes out what has been recorded once a second, so a crash loses at most a second of the run
+    void tick(double now);
+
+    uint64_t recordCount() const
+    {
+        return records;
+    }
+
+private:
+    // The buffer is written out once there might not be room for the longest record
+    static const size_t BufferSize = 64 * 1024;
+    static const size_t MaxRecordSize = 1024;
+
+    void write(const SceneRecord &record);
+    void put(const void* data, size_t size);
+    void flush();
+
+    FILE* file = NULL;
+    std::string fileName;
+    std::vector<char> buffer;
+    size_t used = 0;
+    double lastWrite = 0.0;
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+
+    // Reused for every record so recording never allocates once the strings have grown
+    SceneRecord record;
+};
+
+// Reads a recording back one record at a time
+class RecordReader
+{
+public:
+    bool open(const char* fileName);
+    bool next(SceneRecord &record);
+
+    // Set once next() fails because the file is cut short or damaged, rather than just ending
+    bool damaged = false;
+
+    std::string sceneFile;
+    double startTime = 0.0;
+    double serverValues[ServerValueCount] = {};
+
+private:
+    bool get(void* data, size_t size);
+
+    std::vector<char> buffer;
+    size_t position = 0;
+};
+
+#endif // STAGED_RECORDER_H
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,1560 @@
+// stagedSceneGenerator
+// The staged scene model that is shared by the plugin and the offline scene
+// compiler. See README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "stagedScene.h"
+#include "stagedSceneConfig.h"
+#include "stagedWorld.h"
+#include "plugin_utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <ctype.h>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <math.h>
+#include <random>
+#include <set>
+#include <string.h>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+// Compiled scenes are laid out so that they can be used straight from memory: every field is a fixed size type and
+// every block starts on an 8 byte boundary. They are written in the byte order of the machine that compiled them.
+const char SceneMagic[4] = {'S', 'S', 'G', 'S'};
+const uint32_t SceneVersion = 7;
+const uint32_t SceneByteOrder = 0x01020304;
+
+// BZFlag's default tank, as an upright cylinder
+const float TankRadius = 4.32f;
+const float TankHeight = 2.05f;
+
+// How far along its path a shot is checked for hitting something right away, and how big it is
+const float ShotCheckDistance = 1.0f;
+const float ShotSize = 0.1f;
+
+// How many rings of spots around a tank are tried when nudging it
+const int NudgeRings = 8;
+
+// Only the first few conflicts are listed so a big scene doesn't flood the log
+const int MaxReportedConflicts = 20;
+
+// Tanks are bucketed into square cells as wide as two tanks, so any tank that could touch another is in one of the
+// 3x3 cells around it. That keeps validation linear instead of checking every pair.
+class UniformGrid
+{
+public:
+    explicit UniformGrid(float cellSize) : cellSize(cellSize)
+    {
+    }
+
+    void insert(uint32_t item, const float pos[3])
+    {
+        cells[key(cell(pos[0]), cell(pos[1]))].push_back(item);
+    }
+
+    template <typename Visit>
+    bool anyNear(const float pos[3], Visit visit) const
+    {
+        int32_t x = cell(pos[0]), y = cell(pos[1]);
+        for (int32_t dx = -1; dx <= 1; ++dx)
+        {
+            for (int32_t dy = -1; dy <= 1; ++dy)
+            {
+                auto found = cells.find(key(x + dx, y + dy));
+                if (found == cells.end())
+                    continue;
+                for (uint32_t item : found->second)
+                {
+                    if (visit(item))
+                        return true;
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    int32_t cell(float value) const
+    {
+        return (int32_t)floorf(value / cellSize);
+    }
+
+    static uint64_t key(int32_t x, int32_t y)
+    {
+        return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+    }
+
+    float cellSize;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+};
+
+enum SceneShotColumns {
+    ColumnPos,
+    ColumnDir,
+    ColumnTeam,
+    ColumnFlag,
+    ColumnTarget,
+    ColumnAge,
+    ColumnDistance,
+    ColumnBounces,
+    ColumnGroup,
+    ColumnCount
+};
+
+struct SceneHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t headerSize;
+
+    int32_t mode;
+    int32_t refireMode;
+    uint32_t maxShots;
+    uint32_t playerCount;
+    uint32_t groupCount;
+    double shotSpeed;
+
+    uint32_t shotCount;
+    uint32_t flagCount;
+    uint32_t classStart[ShotSpeedClassCount + 1];
+    uint32_t stringBytes;
+    uint32_t readyFile;
+    int32_t validation;
+    float driftTolerance;
+    uint32_t statsFile;
+    float statsInterval;
+    uint32_t recordFile;
+
+    uint64_t playersOffset;
+    uint64_t groupsOffset;
+    uint64_t flagsOffset;
+    uint64_t stringsOffset;
+    uint64_t shotColumnOffsets[ColumnCount];
+};
+
+struct ScenePlayer
+{
+    int32_t team;
+    uint32_t random;
+    float pos[3];
+    float rot;
+
+    // Offsets into the string block
+    uint32_t flag;
+    uint32_t sectionName;
+
+    uint32_t group;
+};
+
+struct SceneGroup
+{
+    uint32_t name;
+    uint32_t enabled;
+    double delayBetweenShots;
+    double spawnDelay;
+};
+
+size_t align8(size_t size)
+{
+    return (size + 7) & ~(size_t)7;
+}
+
+// Appends a block to the buffer, starting on an 8 byte boundary, and returns where it starts
+uint64_t appendBlock(std::vector<char> &buffer, const void* data, size_t size)
+{
+    size_t offset = align8(buffer.size());
+    buffer.resize(offset + size);
+    if (size > 0)
+        memcpy(&buffer[offset], data, size);
+    return offset;
+}
+
+// Copies a block of count items out of the buffer, making sure it is really inside of it
+template <typename T>
+bool readBlock(const std::vector<char> &buffer, uint64_t offset, size_t count, T* dest)
+{
+    if (offset > buffer.size() || count > (buffer.size() - offset) / sizeof(T))
+        return false;
+    if (count > 0)
+        memcpy(dest, &buffer[offset], count * sizeof(T));
+    return true;
+}
+
+bool isWord(const std::string &value, const char* word)
+{
+    size_t i = 0;
+    for (; i < value.size() && word[i] != '\0'; ++i)
+    {
+        if (tolower((unsigned char)value[i]) != word[i])
+            return false;
+    }
+    return i == value.size() && word[i] == '\0';
+}
+
+// Reads "x y z" the same way as tokenize(pos, " ", 3, false) and atof, leaving pos alone unless there are three parts
+void readPosition(const std::string &value, float pos[3])
+{
+    const char* parts[3];
+    const char* c = value.c_str();
+    int count = 0;
+    while (count < 3)
+    {
+        while (*c == ' ')
+            ++c;
+        if (*c == '\0')
+            break;
+        parts[count++] = c;
+        while (*c != ' ' && *c != '\0')
+            ++c;
+    }
+
+    if (count < 3)
+        return;
+
+    for (int i = 0; i < 3; ++i)
+        pos[i] = atof(parts[i]);
+}
+
+// ShotDelay and SpawnDelay, for the main section and for each group
+bool readDelays(const SceneSection &section, StagedGroup &group)
+{
+    if (section.has(KeyShotDelay)) {
+        group.delayBetweenShots = atof(section.item(KeyShotDelay).c_str());
+        if (group.delayBetweenShots < 0.0 || group.delayBetweenShots > 60.0) {
+            section.error(KeyShotDelay, "ShotDelay must be between 0.0 and 60.0 (inclusive)");
+            return false;
+        }
+    }
+    if (section.has(KeySpawnDelay)) {
+        group.spawnDelay = atof(section.item(KeySpawnDelay).c_str());
+        if (group.spawnDelay < 0.0 || group.spawnDelay > 60.0) {
+            section.error(KeySpawnDelay, "SpawnDelay must be between 0.0 and 60.0 (inclusive)");
+            return false;
+        }
+    }
+    return true;
+}
+
+// How deep includes can go, which also stops a file from including itself forever
+const int MaxIncludeDepth = 8;
+
+// Included files are read on up to this many threads at once
+const unsigned int MaxReaderThreads = 8;
+
+// Where a section's tanks and shots are in the scene of the file it came from, so readConfig can merge them in
+// PluginConfig's order
+struct SectionSpan
+{
+    std::string name;
+    size_t part;
+    int line;
+    size_t firstPlayer, endPlayer;
+    size_t firstShot, endShot;
+
+    bool operator<(const SectionSpan &other) const
+    {
+        return name < other.name;
+    }
+};
+
+// One file of a config, read into a scene of its own
+struct ConfigPart
+{
+    size_t index = 0;
+    std::string fileName;
+    int depth = 0;
+
+    StagedScene scene;
+    std::vector<SectionSpan> spans;
+    std::vector<SceneInclude> includes;
+    SceneSection main;
+    bool hasMain = false;
+
+    bool read = false;
+    std::vector<std::string> messages;
+};
+
+// Reads parts [first, last) on a few threads, each one taking the next file that nobody has started on
+template <typename Read>
+void readParts(std::deque<ConfigPart> &parts, size_t first, size_t last, Read read)
+{
+    std::atomic<size_t> next(first);
+    auto work = [&parts, &next, last, &read]() {
+        for (size_t i = next++; i < last; i = next++)
+            read(parts[i]);
+    };
+
+    const size_t threads = std::min<size_t>(last - first,
+                                            std::min(MaxReaderThreads, std::max(1u, std::thread::hardware_concurrency())));
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; ++i)
+    {
+        // If a thread can't be started, the ones we have (at least this one) read the rest
+        try
+        {
+            pool.emplace_back(work);
+        }
+        catch (const std::system_error &)
+        {
+            break;
+        }
+    }
+
+    work();
+    for (std::thread &thread : pool)
+        thread.join();
+}
+
+template <typename T>
+void mergeSections(std::vector<T> &items, std::deque<ConfigPart> &parts, const std::vector<SectionSpan> &spans,
+                   std::vector<T> StagedScene::*list, size_t SectionSpan::*first, size_t SectionSpan::*end)
+{
+    size_t count = 0;
+    for (const ConfigPart &part : parts)
+        count += (part.scene.*list).size();
+    items.reserve(items.size() + count);
+
+    for (const SectionSpan &span : spans)
+    {
+        std::vector<T> &from = parts[span.part].scene.*list;
+        std::move(from.begin() + span.*first, from.begin() + span.*end, std::back_inserter(items));
+    }
+}
+}
+
+bool StagedScene::load(const char* fileName)
+{
+    if (isBinary(fileName))
+        return readBinary(fileName);
+    return readConfig(fileName);
+}
+
+bool StagedScene::isBinary(const char* fileName)
+{
+    const char* extension = strrchr(fileName, '.');
+    return extension != NULL && makelower(extension) == ".scene";
+}
+
+// The plugin can be started with a playlist instead of a scene
+bool StagedScene::isPlaylist(const char* fileName)
+{
+    const char* extension = strrchr(fileName, '.');
+    return extension != NULL && makelower(extension) == ".playlist";
+}
+
+bool StagedScene::readConfig(const char* configFile)
+{
+    // Each file is read into a scene of its own, with each section turned into tanks and shots as soon as it has
+    // been read. PluginConfig sorted the sections by name, so remember where each one is to merge them in that order.
+    auto readPart = [](ConfigPart &part) {
+        SceneMessageHold hold(part.messages);
+        StagedScene &scene = part.scene;
+        part.read = readSceneSections(part.fileName.c_str(), [&part, &scene](const SceneSection &section) {
+            part.spans.push_back({section.name, part.index, section.line, scene.stagedPlayers.size(), 0,
+                                  scene.stagedShots.size(), 0});
+            if (section.name == "main")
+            {
+                part.main = section;
+                part.hasMain = true;
+            }
+            return scene.readSection(section);
+        }, &part.includes);
+
+        for (size_t i = 0; i < part.spans.size(); ++i)
+        {
+            const bool last = i + 1 == part.spans.size();
+            part.spans[i].endPlayer = last ? scene.stagedPlayers.size() : part.spans[i + 1].firstPlayer;
+            part.spans[i].endShot = last ? scene.stagedShots.size() : part.spans[i + 1].firstShot;
+        }
+    };
+
+    // The config is read first, then everything it includes, then everything those include, and so on. The files
+    // in each round are read at the same time.
+    std::deque<ConfigPart> parts(1);
+    parts[0].fileName = configFile;
+    for (size_t first = 0; first < parts.size(); )
+    {
+        const size_t last = parts.size();
+        readParts(parts, first, last, readPart);
+
+        // Only this thread can write to the log, so the errors from the others are logged now, in order
+        bool read = true;
+        for (size_t i = first; i < last; ++i)
+        {
+            for (const std::string &message : parts[i].messages)
+                bz_debugMessage(0, message.c_str());
+            read = read && parts[i].read;
+        }
+        if (!read)
+            return false;
+
+        for (size_t i = first; i < last; ++i)
+        {
+            for (const SceneInclude &include : parts[i].includes)
+            {
+                if (parts[i].depth == MaxIncludeDepth)
+                {
+                    sceneError("%s:%d: Includes can only be nested %d deep", parts[i].fileName.c_str(), include.line,
+                               MaxIncludeDepth);
+                    return false;
+                }
+
+                std::vector<std::string> files;
+                if (!expandSceneInclude(parts[i].fileName, include.pattern, files))
+                {
+                    sceneError("%s:%d: %s doesn't match any files", parts[i].fileName.c_str(), include.line,
+                               include.pattern.c_str());
+                    return false;
+                }
+
+                for (const std::string &file : files)
+                {
+                    parts.emplace_back();
+                    parts.back().index = parts.size() - 1;
+                    parts.back().fileName = file;
+                    parts.back().depth = parts[i].depth + 1;
+                }
+            }
+        }
+
+        first = last;
+    }
+
+    std::vector<SectionSpan> spans;
+    for (const ConfigPart &part : parts)
+        spans.insert(spans.end(), part.spans.begin(), part.spans.end());
+
+    const bool inOrder = parts.size() == 1 && std::is_sorted(spans.begin(), spans.end());
+    if (!inOrder)
+        std::sort(spans.begin(), spans.end());
+
+    // PluginConfig merged sections with the same name, which is never what was meant
+    for (size_t i = 1; i < spans.size(); ++i)
+    {
+        if (spans[i - 1].name != spans[i].name)
+            continue;
+
+        const SectionSpan* earlier = &spans[i - 1];
+        const SectionSpan* later = &spans[i];
+        if (later->part < earlier->part || (later->part == earlier->part && later->line < earlier->line))
+            std::swap(earlier, later);
+
+        if (earlier->part == later->part)
+            sceneError("%s:%d: [%s] is already on line %d", parts[later->part].fileName.c_str(), later->line,
+                       later->name.c_str(), earlier->line);
+        else
+            sceneError("%s:%d: [%s] is already in %s:%d", parts[later->part].fileName.c_str(), later->line,
+                       later->name.c_str(), parts[earlier->part].fileName.c_str(), earlier->line);
+        return false;
+    }
+
+    for (const ConfigPart &part : parts)
+    {
+        if (part.hasMain && !readMain(part.main))
+            return false;
+    }
+
+    // planVolley puts the groups in order
+    for (const ConfigPart &part : parts)
+        groups.insert(groups.end(), part.scene.groups.begin() + 1, part.scene.groups.end());
+
+    if (inOrder)
+    {
+        stagedPlayers.swap(parts[0].scene.stagedPlayers);
+        stagedShots.swap(parts[0].scene.stagedShots);
+    }
+    else
+    {
+        mergeSections(stagedPlayers, parts, spans, &StagedScene::stagedPlayers, &SectionSpan::firstPlayer, &SectionSpan::endPlayer);
+        mergeSections(stagedShots, parts, spans, &StagedScene::stagedShots, &SectionSpan::firstShot, &SectionSpan::endShot);
+    }
+
+    planVolley();
+
+    return true;
+}
+
+bool StagedScene::readPluginConfig(const char* configFile)
+{
+    // Parse the configuration
+    PluginConfig config;
+    config.read(configFile);
+
+    // If we had any errors, bail out
+    if (config.errors > 0)
+        return false;
+
+    // Loop through each section of the configuration. There will be one section per tank or shot.
+    SceneSection section;
+    for (const std::string &name : config.getSections())
+    {
+        section.clear();
+        section.name = name;
+        for (const auto &item : config.getSectionItems(name))
+        {
+            SceneKey key = SceneSection::keyFromName(makelower(item.first.c_str()).c_str());
+            if (key != SceneKeyCount)
+                section.set(key, item.second);
+        }
+
+        if (!readSection(section))
+            return false;
+    }
+
+    planVolley();
+
+    return true;
+}
+
+bool StagedScene::readSection(const SceneSection &section)
+{
+    // The main section will contain global settings that affect the plugin.
+    if (section.name == "main")
+        return readMain(section);
+
+    const std::string &type = section.item(KeyType);
+
+    // Congratulations Mr. and Mrs. Abrams, it's a tank
+    if (isWord(type, "tank"))
+        return readTank(section);
+    // Guess I'll take a shot at this
+    else if (isWord(type, "shot"))
+        return readShot(section);
+    // Lots of tanks or shots laid out in a pattern
+    else if (isWord(type, "formation"))
+        return expandFormation(section);
+    // A vignette with its own cadence
+    else if (isWord(type, "group"))
+        return readGroup(section);
+
+    return true;
+}
+
+bool StagedScene::readMain(const SceneSection &section)
+{
+    if (!readDelays(section, groups[0]))
+        return false;
+    if (section.has(KeyShotSpeed)) {
+        shotSpeed = atof(section.item(KeyShotSpeed).c_str());
+        if (shotSpeed < 0.01 && shotSpeed > 1000.0) {
+            section.error(KeyShotSpeed, "ShotSpeed must be between 0.01 and 1000.0 (inclusive)");
+            return false;
+        }
+    }
+    if (section.has(KeyRefire)) {
+        const std::string &refire = section.item(KeyRefire);
+        if (isWord(refire, "volley"))
+            refireMode = RefireVolley;
+        else if (isWord(refire, "continuous"))
+            refireMode = RefireContinuous;
+        else {
+            section.error(KeyRefire, "Refire must be one of: volley or continuous");
+            return false;
+        }
+    }
+    if (section.has(KeyValidate)) {
+        const std::string &validate = section.item(KeyValidate);
+        if (isWord(validate, "off"))
+            validation = ValidateOff;
+        else if (isWord(validate, "report"))
+            validation = ValidateReport;
+        else if (isWord(validate, "nudge"))
+            validation = ValidateNudge;
+        else {
+            section.error(KeyValidate, "Validate must be one of: off, report or nudge");
+            return false;
+        }
+    }
+    if (section.has(KeyDriftTolerance)) {
+        driftTolerance = atof(section.item(KeyDriftTolerance).c_str());
+        if (driftTolerance < 0.0f || driftTolerance > 100.0f) {
+            section.error(KeyDriftTolerance, "DriftTolerance must be between 0.0 and 100.0 (inclusive)");
+            return false;
+        }
+    }
+    if (section.has(KeyReadyFile))
+        readyFile = section.item(KeyReadyFile);
+    if (section.has(KeyStatsFile))
+        statsFile = section.item(KeyStatsFile);
+    if (section.has(KeyRecordFile))
+        recordFile = section.item(KeyRecordFile);
+    if (section.has(KeyStatsInterval)) {
+        statsInterval = atof(section.item(KeyStatsInterval).c_str());
+        if (statsInterval < 1.0f || statsInterval > 86400.0f) {
+            section.error(KeyStatsInterval, "StatsInterval must be between 1 and 86400 seconds (inclusive)");
+            return false;
+        }
+    }
+    if (section.has(KeyMaxShots)) {
+        int shots = atoi(section.item(KeyMaxShots).c_str());
+        if (shots < 1 || shots > 255) {
+            section.error(KeyMaxShots, "MaxShots must be between 1 and 255 (inclusive)");
+            return false;
+        }
+        maxShots = shots;
+    }
+    if (section.has(KeyMode))
+    {
+        const std::string &_mode = section.item(KeyMode);
+        if (isWord(_mode, "static1"))
+            mode = ModeStatic1;
+        else if (isWord(_mode, "static2"))
+            mode = ModeStatic2;
+        else if (isWord(_mode, "static3"))
+            mode = ModeStatic3;
+        else if (isWord(_mode, "normal"))
+            mode = ModeNormal;
+        else {
+            section.error(KeyMode, "Mode must be one of: static1, static2, static3, or normal");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool StagedScene::readGroup(const SceneSection &section)
+{
+    StagedGroup g;
+    g.name = section.name;
+
+    if (!readDelays(section, g))
+        return false;
+
+    if (section.has(KeyEnabled)) {
+        const std::string &enabled = section.item(KeyEnabled);
+        if (isWord(enabled, "true"))
+            g.enabled = true;
+        else if (isWord(enabled, "false"))
+            g.enabled = false;
+        else {
+            section.error(KeyEnabled, "Enabled for group '%s' must be true or false", section.name.c_str());
+            return false;
+        }
+    }
+
+    // The groups are put in order and the tanks and shots are matched up with them once the whole scene is read
+    groups.push_back(g);
+    return true;
+}
+
+bool StagedScene::readTank(const SceneSection &section)
+{
+    StagedPlayer p;
+
+    p.sectionName = section.name;
+    p.groupName = makelower(section.item(KeyGroup).c_str());
+    p.team = teamFromString(section.item(KeyTeam));
+    p.flag = makeupper(section.item(KeyFlag).c_str());
+
+    // A tank can be randomly spawned or set to spawn at a fixed location
+    p.random = isWord(section.item(KeyRandom), "true");
+
+    // If it's not random, read the position and rotation, if set
+    if (!p.random)
+    {
+        readPosition(section.item(KeyPos), p.pos);
+
+        const std::string &rot = section.item(KeyRot);
+        if (rot.size() > 0)
+            p.rot = atof(rot.c_str());
+    }
+
+    // Add this staged player to our list
+    stagedPlayers.push_back(p);
+    return true;
+}
+
+bool StagedScene::readShot(const SceneSection &section)
+{
+    StagedShot s;
+
+    s.team = teamFromString(section.item(KeyTeam));
+    s.groupName = makelower(section.item(KeyGroup).c_str());
+
+    // A flag abbreviation can be provided to change the shot type
+    s.flag = makeupper(section.item(KeyFlag).c_str());
+
+    // If it's a GM, we can also have a target
+    if (s.flag == "GM") {
+        s.targetPlayerSectionName = makelower(section.item(KeyTarget).c_str());
+    }
+    else if (s.flag == "L")
+        s.speedClass = ShotSpeedLaser;
+    else if (s.flag == "TH")
+        s.speedClass = ShotSpeedThief;
+
+    readPosition(section.item(KeyPos), s.pos);
+
+    const std::string &strRot = section.item(KeyRot);
+    const std::string &strElev = section.item(KeyElev);
+    double rot = 0, elev = 0;
+    if (strRot.size() > 0)
+        rot = atof(strRot.c_str()) * M_PI / 180.0;
+
+    if (strElev.size() > 0)
+        elev = (atof(strElev.c_str()) * M_PI / 180.0);
+    elev += M_PI / 2;
+
+    s.dir[0] = sin(elev) * cos(rot);
+    s.dir[1] = sin(elev) * sin(rot);
+    s.dir[2] = -cos(elev);
+
+    // A shot can start out part of the way along its path, either by time or by distance
+    const std::string &age = section.item(KeyAge);
+    const std::string &distance = section.item(KeyDistance);
+    if (age.size() > 0 && distance.size() > 0)
+    {
+        section.error(KeyDistance, "Shot '%s' can have an age or a distance, but not both", section.name.c_str());
+        return false;
+    }
+    if (age.size() > 0)
+        s.age = atof(age.c_str());
+    if (distance.size() > 0)
+        s.distance = atof(distance.c_str());
+
+    // A shot can also be moved along its path until it has ricocheted off of the world this many times
+    if (!readBounces(section, s))
+        return false;
+
+    // Add this staged shot to our list
+    stagedShots.push_back(s);
+    return true;
+}
+
+bool StagedScene::expandFormation(const SceneSection &section)
+{
+    const std::string of = makelower(section.item(KeyOf).c_str());
+    const std::string layout = makelower(section.item(KeyLayout).c_str());
+    const std::string facing = makelower(section.item(KeyFacing).c_str());
+
+    if (of != "tank" && of != "shot")
+    {
+        section.error(KeyOf, "Formation '%s' must be of tank or shot", section.name.c_str());
+        return false;
+    }
+    if (layout != "grid" && layout != "ring" && layout != "line" && layout != "spiral")
+    {
+        section.error(KeyLayout, "Formation '%s' layout must be one of: grid, ring, line or spiral", section.name.c_str());
+        return false;
+    }
+    if (!facing.empty() && facing != "fixed" && facing != "outward" && facing != "inward" && facing != "tangent")
+    {
+        section.error(KeyFacing, "Formation '%s' facing must be one of: fixed, outward, inward or tangent", section.name.c_str());
+        return false;
+    }
+
+    const int count = atoi(section.item(KeyCount).c_str());
+    if (count < 1 || count > 100000)
+    {
+        section.error(KeyCount, "Formation '%s' count must be between 1 and 100000 (inclusive)", section.name.c_str());
+        return false;
+    }
+
+    auto number = [&section](SceneKey key, double defaultValue) {
+        const std::string &value = section.item(key);
+        return value.empty() ? defaultValue : atof(value.c_str());
+    };
+
+    float center[3] = {0.0f, 0.0f, 0.0f};
+    readPosition(section.item(KeyPos), center);
+
+    // The layout is turned by rot, and each item faces heading degrees relative to its facing rule
+    const double spacing = number(KeySpacing, 10.0);
+    const double turn = number(KeyRot, 0.0) * M_PI / 180.0;
+    const double heading = number(KeyHeading, 0.0) * M_PI / 180.0;
+    const double jitter = number(KeyJitter, 0.0);
+    const double rotJitter = number(KeyRotJitter, 0.0) * M_PI / 180.0;
+    const int columns = std::max(1, (int)number(KeyColumns, ceil(sqrt((double)count))));
+    const double radius = number(KeyRadius, std::max(spacing, spacing * count / (2.0 * M_PI)));
+
+    // Work out every position and rotation first, then build the tanks or shots from those in one go
+    std::vector<float> positions(count * 3);
+    std::vector<double> rotations(count);
+    const int rows = (count + columns - 1) / columns;
+    const double goldenAngle = M_PI * (3.0 - sqrt(5.0));
+    for (int i = 0; i < count; ++i)
+    {
+        double x = 0.0, y = 0.0;
+        if (layout == "grid")
+        {
+            x = ((i % columns) - (columns - 1) / 2.0) * spacing;
+            y = ((i / columns) - (rows - 1) / 2.0) * spacing;
+        }
+        else if (layout == "line")
+            x = (i - (count - 1) / 2.0) * spacing;
+        else if (layout == "ring")
+        {
+            x = radius * cos(2.0 * M_PI * i / count);
+            y = radius * sin(2.0 * M_PI * i / count);
+        }
+        else
+        {
+            // A sunflower spiral keeps the items evenly spread no matter how many there are
+            x = spacing * sqrt((double)i) * cos(i * goldenAngle);
+            y = spacing * sqrt((double)i) * sin(i * goldenAngle);
+        }
+
+        positions[i * 3] = center[0] + (float)(x * cos(turn) - y * sin(turn));
+        positions[i * 3 + 1] = center[1] + (float)(x * sin(turn) + y * cos(turn));
+        positions[i * 3 + 2] = center[2];
+
+        double outward = (x == 0.0 && y == 0.0) ? 0.0 : atan2(y, x) + turn;
+        if (facing == "outward")
+            rotations[i] = outward + heading;
+        else if (facing == "inward")
+            rotations[i] = outward + M_PI + heading;
+        else if (facing == "tangent")
+            rotations[i] = outward + M_PI / 2.0 + heading;
+        else
+            rotations[i] = heading;
+    }
+
+    // Seeded so the same config always gives the same scene
+    if (jitter > 0.0 || rotJitter > 0.0)
+    {
+        std::mt19937 random((uint32_t)atoi(section.item(KeySeed).c_str()));
+        std::uniform_real_distribution<double> unit(-1.0, 1.0);
+        for (int i = 0; i < count; ++i)
+        {
+            positions[i * 3] += (float)(jitter * unit(random));
+            positions[i * 3 + 1] += (float)(jitter * unit(random));
+            rotations[i] += rotJitter * unit(random);
+        }
+    }
+
+    // Each item gets its own section name so GM shots can target generated tanks, like wall#12
+    const std::string baseName = section.name + "#";
+    const bz_eTeamType team = teamFromString(section.item(KeyTeam));
+    const std::string flag = makeupper(section.item(KeyFlag).c_str());
+    const std::string groupName = makelower(section.item(KeyGroup).c_str());
+
+    if (of == "tank")
+    {
+        stagedPlayers.reserve(stagedPlayers.size() + count);
+        for (int i = 0; i < count; ++i)
+        {
+            StagedPlayer p;
+            p.sectionName = baseName + std::to_string(i);
+            p.groupName = groupName;
+            p.team = team;
+            p.flag = flag;
+            std::copy(&positions[i * 3], &positions[i * 3] + 3, p.pos);
+            p.rot = (float)(rotations[i] * 180.0 / M_PI);
+            stagedPlayers.push_back(p);
+        }
+        return true;
+    }
+
+    const std::string &age = section.item(KeyAge);
+    const std::string &distance = section.item(KeyDistance);
+    if (age.size() > 0 && distance.size() > 0)
+    {
+        section.error(KeyDistance, "Formation '%s' can have an age or a distance, but not both", section.name.c_str());
+        return false;
+    }
+
+    StagedShot s;
+    s.team = team;
+    s.flag = flag;
+    s.groupName = groupName;
+    if (s.flag == "GM")
+        s.targetPlayerSectionName = makelower(section.item(KeyTarget).c_str());
+    else if (s.flag == "L")
+        s.speedClass = ShotSpeedLaser;
+    else if (s.flag == "TH")
+        s.speedClass = ShotSpeedThief;
+    s.age = (float)atof(age.c_str());
+    s.distance = (float)atof(distance.c_str());
+    if (!readBounces(section, s))
+        return false;
+
+    // The elevation is the same for the whole formation, so only the rotation changes from shot to shot
+    const double elev = number(KeyElev, 0.0) * M_PI / 180.0 + M_PI / 2;
+    const float horizontal = (float)sin(elev), vertical = (float)-cos(elev);
+
+    stagedShots.reserve(stagedShots.size() + count);
+    for (int i = 0; i < count; ++i)
+    {
+        std::copy(&positions[i * 3], &positions[i * 3] + 3, s.pos);
+        s.dir[0] = horizontal * (float)cos(rotations[i]);
+        s.dir[1] = horizontal * (float)sin(rotations[i]);
+        s.dir[2] = vertical;
+        stagedShots.push_back(s);
+    }
+
+    return true;
+}
+
+bool StagedScene::readBounces(const SceneSection &section, StagedShot &shot)
+{
+    const std::string &bounces = section.item(KeyBounces);
+    if (bounces.empty())
+        return true;
+
+    shot.bounces = atoi(bounces.c_str());
+    if (shot.bounces < 0 || shot.bounces > 32)
+    {
+        section.error(KeyBounces, "Bounces for '%s' must be between 0 and 32 (inclusive)", section.name.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool StagedScene::needsRicochets() const
+{
+    for (auto &stagedShot : stagedShots)
+    {
+        if (stagedShot.bounces > 0)
+            return true;
+    }
+    return false;
+}
+
+int StagedScene::solveRicochets(const StagedWorld &world)
+{
+    // The shot table is in the same order as the staged shots, so both get the post-bounce path
+    int solved = 0;
+    for (size_t i = 0; i < stagedShots.size(); ++i)
+    {
+        StagedShot &stagedShot = stagedShots[i];
+        if (stagedShot.bounces == 0)
+            continue;
+
+        if (!world.ricochet(stagedShot.pos, stagedShot.dir, stagedShot.bounces))
+            bz_debugMessagef(0, "WARNING: Staged shot %u hits the ground or never bounces %d times, so it is left where it is",
+                             (unsigned)i, stagedShot.bounces);
+        else
+        {
+            std::copy(stagedShot.pos, stagedShot.pos + 3, &shotTable.pos[i * 3]);
+            std::copy(stagedShot.dir, stagedShot.dir + 3, &shotTable.dir[i * 3]);
+            ++solved;
+        }
+
+        stagedShot.bounces = 0;
+    }
+
+    return solved;
+}
+
+float StagedScene::startDistance(const StagedShot &stagedShot, const ServerShotSpeeds &speeds) const
+{
+    if (stagedShot.speedClass != ShotSpeedNormal)
+        return 0.0f;
+    if (stagedShot.age == 0.0f)
+        return stagedShot.distance;
+
+    // The static modes fire every normal shot at the scene's speed, and otherwise F and MG fly faster
+    double speed = speeds.shotSpeed;
+    if (mode == ModeStatic1 || mode == ModeStatic2)
+        speed = shotSpeed;
+    else if (stagedShot.flag == "F")
+        speed *= speeds.rapidFireAdVel;
+    else if (stagedShot.flag == "MG")
+        speed *= speeds.machineGunAdVel;
+
+    return (float)(stagedShot.age * speed);
+}
+
+int StagedScene::validate(const StagedWorld *world, const ServerShotSpeeds &speeds)
+{
+    if (validation == ValidateOff)
+        return 0;
+
+    int conflicts = 0;
+    char message[256];
+    auto report = [&conflicts, &message]() {
+        if (++conflicts <= MaxReportedConflicts)
+            bz_debugMessage(0, message);
+    };
+
+    // Each tank is only checked against the tanks before it, so every pair is looked at once
+    UniformGrid tanks(2.0f * TankRadius);
+
+    auto overlappingTank = [this, &tanks](const float pos[3], uint32_t &other) {
+        return tanks.anyNear(pos, [this, pos, &other](uint32_t j) {
+            const float* otherPos = stagedPlayers[j].pos;
+            float dx = pos[0] - otherPos[0], dy = pos[1] - otherPos[1];
+            other = j;
+            return fabsf(pos[2] - otherPos[2]) < TankHeight && dx * dx + dy * dy < 4.0f * TankRadius * TankRadius;
+        });
+    };
+    auto blocked = [world](const float pos[3]) {
+        return world != NULL && world->blocksCylinder(pos, TankRadius, TankHeight);
+    };
+
+    int nudged = 0;
+    for (uint32_t i = 0; i < stagedPlayers.size(); ++i)
+    {
+        StagedPlayer &stagedPlayer = stagedPlayers[i];
+        if (stagedPlayer.random)
+            continue;
+
+        uint32_t other = 0;
+        bool overlaps = overlappingTank(stagedPlayer.pos, other);
+        bool inside = !overlaps && blocked(stagedPlayer.pos);
+
+        // Try spots in rings around the tank until one is clear
+        if ((overlaps || inside) && validation == ValidateNudge)
+        {
+            bool moved = false;
+            for (int ring = 1; !moved && ring <= NudgeRings; ++ring)
+            {
+                for (int spot = 0; !moved && spot < 8 * ring; ++spot)
+                {
+                    double angle = 2.0 * M_PI * spot / (8 * ring);
+                    float candidate[3] = {
+                        stagedPlayer.pos[0] + (float)(ring * TankRadius * cos(angle)),
+                        stagedPlayer.pos[1] + (float)(ring * TankRadius * sin(angle)),
+                        stagedPlayer.pos[2]
+                    };
+                    uint32_t ignored;
+                    if (!overlappingTank(candidate, ignored) && !blocked(candidate))
+                    {
+                        bz_debugMessagef(1, "INFO: Moved tank '%s' from %.1f %.1f to %.1f %.1f", stagedPlayer.sectionName.c_str(),
+                                         stagedPlayer.pos[0], stagedPlayer.pos[1], candidate[0], candidate[1]);
+                        std::copy(candidate, candidate + 3, stagedPlayer.pos);
+                        moved = true;
+                    }
+                }
+            }
+
+            if (moved)
+            {
+                ++nudged;
+                overlaps = inside = false;
+            }
+        }
+
+        if (overlaps)
+        {
+            snprintf(message, sizeof(message), "WARNING: Tank '%s' overlaps tank '%s'", stagedPlayer.sectionName.c_str(),
+                     stagedPlayers[other].sectionName.c_str());
+            report();
+        }
+        else if (inside)
+        {
+            snprintf(message, sizeof(message), "WARNING: Tank '%s' is inside of an obstacle or outside of the world",
+                     stagedPlayer.sectionName.c_str());
+            report();
+        }
+
+        tanks.insert(i, stagedPlayer.pos);
+    }
+
+    // Shots are only reported, since moving them would change the picture
+    for (uint32_t i = 0; i < stagedShots.size(); ++i)
+    {
+        const StagedShot &stagedShot = stagedShots[i];
+        const float distance = startDistance(stagedShot, speeds);
+        float pos[3];
+        for (int k = 0; k < 3; ++k)
+            pos[k] = stagedShot.pos[k] + stagedShot.dir[k] * distance;
+
+        uint32_t hitTank = 0;
+        bool inTank = tanks.anyNear(pos, [this, pos, &hitTank](uint32_t j) {
+            const float* tankPos = stagedPlayers[j].pos;
+            float dx = pos[0] - tankPos[0], dy = pos[1] - tankPos[1];
+            hitTank = j;
+            return pos[2] >= tankPos[2] && pos[2] <= tankPos[2] + TankHeight && dx * dx + dy * dy < TankRadius * TankRadius;
+        });
+
+        WorldHit hit;
+        if (inTank)
+        {
+            snprintf(message, sizeof(message), "WARNING: Staged shot %u at %.1f %.1f %.1f starts inside tank '%s'", i, pos[0], pos[1],
+                     pos[2], stagedPlayers[hitTank].sectionName.c_str());
+            report();
+        }
+        else if (world != NULL && (world->blocksCylinder(pos, ShotSize, ShotSize)
+                                   || world->trace(pos, stagedShot.dir, ShotCheckDistance, hit)))
+        {
+            snprintf(message, sizeof(message), "WARNING: Staged shot %u at %.1f %.1f %.1f hits the world as soon as it is fired", i,
+                     pos[0], pos[1], pos[2]);
+            report();
+        }
+    }
+
+    if (conflicts > MaxReportedConflicts)
+        bz_debugMessagef(0, "WARNING: ...and %d more placement problems", conflicts - MaxReportedConflicts);
+    if (nudged > 0)
+        bz_debugMessagef(0, "INFO: Nudged %d tanks to clear spots", nudged);
+
+    return conflicts;
+}
+
+uint16_t StagedScene::internFlag(const std::string &flag)
+{
+    for (size_t i = 0; i < shotFlags.size(); ++i)
+    {
+        if (shotFlags[i] == flag)
+            return (uint16_t)i;
+    }
+
+    shotFlags.push_back(flag);
+    return (uint16_t)(shotFlags.size() - 1);
+}
+
+void StagedScene::planVolley()
+{
+    // Put the groups in PluginConfig's order, after the main group, and match the tanks and shots up with them
+    std::sort(groups.begin() + 1, groups.end(), [](const StagedGroup &a, const StagedGroup &b) {
+        return a.name < b.name;
+    });
+
+    std::map<std::string, uint16_t> groupByName;
+    for (size_t i = 0; i < groups.size(); ++i)
+        groupByName[groups[i].name] = (uint16_t)i;
+
+    std::set<std::string> missingGroups;
+    auto resolveGroup = [&groupByName, &missingGroups](const std::string &groupName) {
+        if (groupName.empty())
+            return (uint16_t)0;
+        auto found = groupByName.find(groupName);
+        if (found != groupByName.end())
+            return found->second;
+        if (missingGroups.insert(groupName).second)
+            bz_debugMessagef(0, "WARNING: Group '%s' is not a group section, so its tanks and shots are in the main group", groupName.c_str());
+        return (uint16_t)0;
+    };
+    for (auto &stagedPlayer : stagedPlayers)
+        stagedPlayer.group = resolveGroup(stagedPlayer.groupName);
+    for (auto &stagedShot : stagedShots)
+        stagedShot.group = resolveGroup(stagedShot.groupName);
+
+    // Group the shots by the shot speed they need so the volley only has to change _shotSpeed once per group, and
+    // then by scene group so each one can fire its volley from one run of shots per speed
+    std::stable_sort(stagedShots.begin(), stagedShots.end(), [](const StagedShot &a, const StagedShot &b) {
+        return a.speedClass < b.speedClass || (a.speedClass == b.speedClass && a.group < b.group);
+    });
+
+    // Resolve the GM targets once so that joins and parts don't have to compare section names
+    std::map<std::string, int> slotBySection;
+    for (size_t i = 0; i < stagedPlayers.size(); ++i)
+        slotBySection[stagedPlayers[i].sectionName] = (int)i;
+
+    // Lay the shots out the way the volley reads them
+    const size_t count = stagedShots.size();
+    shotTable.pos.resize(count * 3);
+    shotTable.dir.resize(count * 3);
+    shotTable.team.resize(count);
+    shotTable.flag.resize(count);
+    shotTable.target.assign(count, -1);
+    shotTable.targetPlayerID.assign(count, -1);
+    shotTable.group.resize(count);
+
+    shotFlags.clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const StagedShot &stagedShot = stagedShots[i];
+        std::copy(stagedShot.pos, stagedShot.pos + 3, &shotTable.pos[i * 3]);
+        std::copy(stagedShot.dir, stagedShot.dir + 3, &shotTable.dir[i * 3]);
+        shotTable.team[i] = stagedShot.team;
+        shotTable.flag[i] = internFlag(stagedShot.flag);
+        shotTable.group[i] = stagedShot.group;
+
+        if (!stagedShot.targetPlayerSectionName.empty())
+        {
+            auto found = slotBySection.find(stagedShot.targetPlayerSectionName);
+            if (found != slotBySection.end())
+                shotTable.target[i] = found->second;
+            else
+                bz_debugMessagef(0, "WARNING: Staged shot target '%s' is not a staged tank", stagedShot.targetPlayerSectionName.c_str());
+        }
+    }
+
+    for (int c = 0; c <= ShotSpeedClassCount; ++c)
+    {
+        shotTable.classStart[c] = std::lower_bound(stagedShots.begin(), stagedShots.end(), c, [](const StagedShot &shot, int speedClass) {
+            return shot.speedClass < speedClass;
+        }) - stagedShots.begin();
+    }
+}
+
+int StagedScene::shotSpeedWritesSaved() const
+{
+    if (mode != ModeStatic1 && mode != ModeStatic2)
+        return 0;
+
+    // Each laser or thief used to set _shotSpeed before firing and reset it after. Now each group's volley sets it
+    // once for each class it has shots in, and resets it once at the end if it changed it.
+    int beforeWrites = 2 * (int)(shotTable.size() - shotTable.classStart[ShotSpeedLaser]), afterWrites = 0;
+    std::vector<bool> changesShotSpeed(groups.size(), false);
+    for (int c = ShotSpeedLaser; c < ShotSpeedClassCount; ++c)
+    {
+        // Each class is sorted by group, so every run of one group's shots is one switch
+        for (size_t i = shotTable.classStart[c]; i < shotTable.classStart[c + 1]; ++i)
+        {
+            if (i > shotTable.classStart[c] && shotTable.group[i] == shotTable.group[i - 1])
+                continue;
+
+            ++afterWrites;
+            if (!changesShotSpeed[shotTable.group[i]])
+            {
+                changesShotSpeed[shotTable.group[i]] = true;
+                ++afterWrites;
+            }
+        }
+    }
+
+    return beforeWrites - afterWrites;
+}
+
+bool StagedScene::writeBinary(const char* sceneFile) const
+{
+    SceneHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SceneMagic, sizeof(header.magic));
+    header.version = SceneVersion;
+    header.byteOrder = SceneByteOrder;
+    header.headerSize = sizeof(SceneHeader);
+    header.mode = mode;
+    header.refireMode = refireMode;
+    header.validation = validation;
+    header.driftTolerance = driftTolerance;
+    header.statsInterval = statsInterval;
+    header.maxShots = (uint32_t)maxShots;
+    header.playerCount = (uint32_t)stagedPlayers.size();
+    header.groupCount = (uint32_t)groups.size();
+    header.shotSpeed = shotSpeed;
+    header.shotCount = (uint32_t)shotTable.size();
+    header.flagCount = (uint32_t)shotFlags.size();
+    for (int c = 0; c <= ShotSpeedClassCount; ++c)
+        header.classStart[c] = (uint32_t)shotTable.classStart[c];
+
+    // All of the strings go into one block of nul terminated strings
+    std::string strings;
+    auto addString = [&strings](const std::string &str) {
+        uint32_t offset = (uint32_t)strings.size();
+        strings.append(str);
+        strings.push_back('\0');
+        return offset;
+    };
+
+    std::vector<ScenePlayer> players(stagedPlayers.size());
+    for (size_t i = 0; i < stagedPlayers.size(); ++i)
+    {
+        const StagedPlayer &stagedPlayer = stagedPlayers[i];
+        ScenePlayer &player = players[i];
+        memset(&player, 0, sizeof(player));
+        player.team = stagedPlayer.team;
+        player.random = stagedPlayer.random ? 1 : 0;
+        std::copy(stagedPlayer.pos, stagedPlayer.pos + 3, player.pos);
+        player.rot = stagedPlayer.rot;
+        player.flag = addString(stagedPlayer.flag);
+        player.sectionName = addString(stagedPlayer.sectionName);
+        player.group = stagedPlayer.group;
+    }
+
+    std::vector<SceneGroup> sceneGroups(groups.size());
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        SceneGroup &group = sceneGroups[i];
+        memset(&group, 0, sizeof(group));
+        group.name = addString(groups[i].name);
+        group.enabled = groups[i].enabled ? 1 : 0;
+        group.delayBetweenShots = groups[i].delayBetweenShots;
+        group.spawnDelay = groups[i].spawnDelay;
+    }
+
+    std::vector<uint32_t> flags(shotFlags.size());
+    for (size_t i = 0; i < shotFlags.size(); ++i)
+        flags[i] = addString(shotFlags[i]);
+    header.readyFile = addString(readyFile);
+    header.statsFile = addString(statsFile);
+    header.recordFile = addString(recordFile);
+    header.stringBytes = (uint32_t)strings.size();
+
+    // The columns that only exist in the staged shots
+    std::vector<int32_t> teams(shotTable.team.begin(), shotTable.team.end());
+    std::vector<int32_t> targets(shotTable.target.begin(), shotTable.target.end());
+    std::vector<float> ages(stagedShots.size()), distances(stagedShots.size());
+    std::vector<int32_t> bounces(stagedShots.size());
+    for (size_t i = 0; i < stagedShots.size(); ++i)
+    {
+        ages[i] = stagedShots[i].age;
+        distances[i] = stagedShots[i].distance;
+        bounces[i] = stagedShots[i].bounces;
+    }
+
+    std::vector<char> buffer(sizeof(SceneHeader));
+    header.playersOffset = appendBlock(buffer, players.data(), players.size() * sizeof(ScenePlayer));
+    header.groupsOffset = appendBlock(buffer, sceneGroups.data(), sceneGroups.size() * sizeof(SceneGroup));
+    header.flagsOffset = appendBlock(buffer, flags.data(), flags.size() * sizeof(uint32_t));
+    header.stringsOffset = appendBlock(buffer, strings.data(), strings.size());
+    header.shotColumnOffsets[ColumnPos] = appendBlock(buffer, shotTable.pos.data(), shotTable.pos.size() * sizeof(float));
+    header.shotColumnOffsets[ColumnDir] = appendBlock(buffer, shotTable.dir.data(), shotTable.dir.size() * sizeof(float));
+    header.shotColumnOffsets[ColumnTeam] = appendBlock(buffer, teams.data(), teams.size() * sizeof(int32_t));
+    header.shotColumnOffsets[ColumnFlag] = appendBlock(buffer, shotTable.flag.data(), shotTable.flag.size() * sizeof(uint16_t));
+    header.shotColumnOffsets[ColumnTarget] = appendBlock(buffer, targets.data(), targets.size() * sizeof(int32_t));
+    header.shotColumnOffsets[ColumnAge] = appendBlock(buffer, ages.data(), ages.size() * sizeof(float));
+    header.shotColumnOffsets[ColumnDistance] = appendBlock(buffer, distances.data(), distances.size() * sizeof(float));
+    header.shotColumnOffsets[ColumnBounces] = appendBlock(buffer, bounces.data(), bounces.size() * sizeof(int32_t));
+    header.shotColumnOffsets[ColumnGroup] = appendBlock(buffer, shotTable.group.data(), shotTable.group.size() * sizeof(uint16_t));
+    buffer.resize(align8(buffer.size()));
+    memcpy(&buffer[0], &header, sizeof(header));
+
+    std::ofstream out(sceneFile, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out || !out.write(&buffer[0], buffer.size()))
+    {
+        bz_debugMessagef(0, "ERROR: Unable to write the scene file %s", sceneFile);
+        return false;
+    }
+
+    return true;
+}
+
+bool StagedScene::readBinary(const char* sceneFile)
+{
+    std::ifstream in(sceneFile, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!in)
+    {
+        bz_debugMessagef(0, "ERROR: Unable to open the scene file %s", sceneFile);
+        return false;
+    }
+
+    std::vector<char> buffer((size_t)in.tellg());
+    in.seekg(0);
+    if (buffer.size() < sizeof(SceneHeader) || !in.read(&buffer[0], buffer.size()))
+    {
+        bz_debugMessagef(0, "ERROR: %s is not a compiled scene", sceneFile);
+        return false;
+    }
+
+    SceneHeader header;
+    memcpy(&header, &buffer[0], sizeof(header));
+    if (memcmp(header.magic, SceneMagic, sizeof(header.magic)) != 0 || header.headerSize != sizeof(SceneHeader))
+    {
+        bz_debugMessagef(0, "ERROR: %s is not a compiled scene", sceneFile);
+        return false;
+    }
+    if (header.version != SceneVersion || header.byteOrder != SceneByteOrder)
+    {
+        bz_debugMessagef(0, "ERROR: %s was compiled by a different version of stagedSceneCompiler or on a different platform", sceneFile);
+        return false;
+    }
+
+    // A damaged header mustn't make the server allocate more than the file could hold, or run past the shot table
+    const uint64_t fileSize = buffer.size();
+    bool sane = (uint64_t)header.playerCount * sizeof(ScenePlayer) <= fileSize
+                && (uint64_t)header.groupCount * sizeof(SceneGroup) <= fileSize
+                && (uint64_t)header.flagCount * sizeof(uint32_t) <= fileSize
+                && header.stringBytes <= fileSize
+                && (uint64_t)header.shotCount * 3 * sizeof(float) <= fileSize
+                && header.mode >= ModeStatic1 && header.mode <= ModeNormal
+                && header.refireMode >= RefireVolley && header.refireMode <= RefireContinuous
+                && header.validation >= ValidateOff && header.validation <= ValidateNudge
+                && header.classStart[0] == 0;
+    for (int c = 0; sane && c < ShotSpeedClassCount; ++c)
+        sane = header.classStart[c] <= header.classStart[c + 1] && header.classStart[c + 1] <= header.shotCount;
+    if (!sane)
+    {
+        bz_debugMessagef(0, "ERROR: The scene file %s is damaged", sceneFile);
+        return false;
+    }
+
+    const uint32_t shotCount = header.shotCount;
+    std::vector<ScenePlayer> players(header.playerCount);
+    std::vector<SceneGroup> sceneGroups(header.groupCount);
+    std::vector<uint32_t> flags(header.flagCount);
+    std::string strings(header.stringBytes, '\0');
+    std::vector<int32_t> teams(shotCount), targets(shotCount);
+    std::vector<float> ages(shotCount), distances(shotCount);
+    std::vector<int32_t> bounces(shotCount);
+
+    shotTable.pos.resize(shotCount * 3);
+    shotTable.dir.resize(shotCount * 3);
+    shotTable.flag.resize(shotCount);
+    shotTable.group.resize(shotCount);
+
+    bool valid = readBlock(buffer, header.playersOffset, players.size(), players.data())
+                 && readBlock(buffer, header.groupsOffset, sceneGroups.size(), sceneGroups.data())
+                 && readBlock(buffer, header.flagsOffset, flags.size(), flags.data())
+                 && readBlock(buffer, header.stringsOffset, strings.size(), &strings[0])
+                 && readBlock(buffer, header.shotColumnOffsets[ColumnPos], shotTable.pos.size(), shotTable.pos.data())
+                 && readBlock(buffer, header.shotColumnOffsets[ColumnDir], shotTable.dir.size(), shotTable.dir.data())
+                 && readBlock(buffer, header.shotColumnOffsets[ColumnTeam], teams.size(), teams.data())
+                 && readBlock(buffer, header.shotColumnOffsets[ColumnFlag], shotTable.flag.size(), shotTable.flag.data())
+                 && readBlock(buffer, header.shotColumnOffsets[ColumnTarget], targets.size(), targets.data())
+                 && readBlock(buffer, header.shotColumnOffsets[ColumnAge], ages.size(), ages.data())
+                 && readBlock(buffer, header.shotColumnOffsets[ColumnDistance], distances.size(), distances.data())
+                 && readBlock(buffer, header.shotColumnOffsets[ColumnBounces], bounces.size(), bounces.data())
+                 && readBlock(buffer, header.shotColumnOffsets[ColumnGroup], shotTable.group.size(), shotTable.group.data())
+                 && header.groupCount > 0 && header.groupCount <= 65536
+                 && header.classStart[ShotSpeedClassCount] == shotCount
+                 && (strings.empty() || strings.back() == '\0');
+
+    auto getString = [&strings, &valid](uint32_t offset) {
+        if (offset >= strings.size())
+        {
+            valid = false;
+            return std::string();
+        }
+        return std::string(&strings[offset]);
+    };
+
+    mode = (SceneModes)header.mode;
+    refireMode = (SceneRefireModes)header.refireMode;
+    validation = (SceneValidation)header.validation;
+    driftTolerance = header.driftTolerance;
+    maxShots = header.maxShots;
+    shotSpeed = header.shotSpeed;
+    readyFile = getString(header.readyFile);
+    statsFile = getString(header.statsFile);
+    recordFile = getString(header.recordFile);
+    statsInterval = header.statsInterval;
+
+    groups.assign(sceneGroups.size(), StagedGroup());
+    for (size_t i = 0; valid && i < sceneGroups.size(); ++i)
+    {
+        StagedGroup &group = groups[i];
+        group.name = getString(sceneGroups[i].name);
+        group.enabled = sceneGroups[i].enabled != 0;
+        group.delayBetweenShots = sceneGroups[i].delayBetweenShots;
+        group.spawnDelay = sceneGroups[i].spawnDelay;
+    }
+
+    stagedPlayers.assign(players.size(), StagedPlayer());
+    for (size_t i = 0; valid && i < players.size(); ++i)
+    {
+        if (players[i].group >= groups.size())
+        {
+            valid = false;
+            break;
+        }
+
+        StagedPlayer &stagedPlayer = stagedPlayers[i];
+        stagedPlayer.team = (bz_eTeamType)players[i].team;
+        stagedPlayer.random = players[i].random != 0;
+        std::copy(players[i].pos, players[i].pos + 3, stagedPlayer.pos);
+        stagedPlayer.rot = players[i].rot;
+        stagedPlayer.flag = getString(players[i].flag);
+        stagedPlayer.sectionName = getString(players[i].sectionName);
+        stagedPlayer.group = (uint16_t)players[i].group;
+        if (stagedPlayer.group > 0)
+            stagedPlayer.groupName = groups[stagedPlayer.group].name;
+    }
+
+    shotFlags.resize(flags.size());
+    for (size_t i = 0; valid && i < flags.size(); ++i)
+        shotFlags[i] = getString(flags[i]);
+
+    for (int c = 0; c <= ShotSpeedClassCount; ++c)
+        shotTable.classStart[c] = header.classStart[c];
+
+    // The shot table is already planned, so fill in the staged shots from it rather than planning it again
+    shotTable.team.resize(shotCount);
+    shotTable.target.resize(shotCount);
+    shotTable.targetPlayerID.assign(shotCount, -1);
+    stagedShots.assign(shotCount, StagedShot());
+    int speedClass = ShotSpeedNormal;
+    for (uint32_t i = 0; valid && i < shotCount; ++i)
+    {
+        while (i >= shotTable.classStart[speedClass + 1])
+            ++speedClass;
+
+        // The volleys find each group's shots by a binary search within the speed class
+        if (shotTable.flag[i] >= shotFlags.size() || targets[i] < -1 || targets[i] >= (int)stagedPlayers.size()
+            || shotTable.group[i] >= groups.size()
+            || (i > shotTable.classStart[speedClass] && shotTable.group[i] < shotTable.group[i - 1]))
+        {
+            valid = false;
+            break;
+        }
+
+        shotTable.team[i] = (bz_eTeamType)teams[i];
+        shotTable.target[i] = targets[i];
+
+        StagedShot &stagedShot = stagedShots[i];
+        stagedShot.team = shotTable.team[i];
+        std::copy(&shotTable.pos[i * 3], &shotTable.pos[i * 3] + 3, stagedShot.pos);
+        std::copy(&shotTable.dir[i * 3], &shotTable.dir[i * 3] + 3, stagedShot.dir);
+        stagedShot.flag = shotFlags[shotTable.flag[i]];
+        stagedShot.speedClass = (ShotSpeedClass)speedClass;
+        if (targets[i] >= 0)
+            stagedShot.targetPlayerSectionName = stagedPlayers[targets[i]].sectionName;
+        stagedShot.age = ages[i];
+        stagedShot.distance = distances[i];
+        stagedShot.bounces = bounces[i];
+        stagedShot.group = shotTable.group[i];
+        if (stagedShot.group > 0)
+            stagedShot.groupName = groups[stagedShot.group].name;
+    }
+
+    if (!valid)
+    {
+        bz_debugMessagef(0, "ERROR: The scene file %s is damaged", sceneFile);
+        return false;
+    }
+
+    return true;
+}
+
+int StagedScene::findGroup(const std::string &name) const
+{
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        if (groups[i].name == name)
+            return (int)i;
+    }
+    return -1;
+}
+
+bz_eTeamType StagedScene::teamFromString(std::string team)
+{
+    team = makelower(team.c_str());
+    if (team == "red") return eRedTeam;
+    else if (team == "green") return eGreenTeam;
+    else if (team == "blue") return eBlueTeam;
+    else if (team == "purple") return ePurpleTeam;
+    else if (team == "hunter") return eHunterTeam;
+    else if (team == "rabbit") return eRabbitTeam;
+
+    return eRogueTeam;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
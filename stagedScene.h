@@ -0,0 +1,265 @@
+// stagedSceneGenerator
+// The staged scene model that is shared by the plugin and the offline scene
+// compiler. See README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#ifndef STAGED_SCENE_H
+#define STAGED_SCENE_H
+
+#include "bzfsAPI.h"
+
+class StagedWorld;
+struct SceneSection;
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum SceneModes {
+    ModeStatic1,
+    ModeStatic2,
+    ModeStatic3,
+    ModeNormal
+};
+
+// Volley fires every shot together once the previous volley is reloaded. Continuous re-fires each shot as soon as it
+// expires, with the shots taking turns if there are more of them than MaxShots.
+enum SceneRefireModes {
+    RefireVolley,
+    RefireContinuous
+};
+
+// What to do about tanks that overlap each other or the world, and shots that hit something as soon as they're fired
+enum SceneValidation {
+    ValidateOff,
+    ValidateReport,
+    ValidateNudge
+};
+
+// The laser and thief length is based on shot speed, so in the static modes these need a different _shotSpeed
+enum ShotSpeedClass {
+    ShotSpeedNormal,
+    ShotSpeedLaser,
+    ShotSpeedThief,
+    ShotSpeedClassCount
+};
+
+// The server's shot speeds, which the normal shots fly at outside of the static modes. These start out as the bzfs
+// defaults, for when there's no server to ask.
+struct ServerShotSpeeds
+{
+    double shotSpeed{100.0};
+    double rapidFireAdVel{1.5};
+    double machineGunAdVel{1.5};
+};
+
+// A part of the scene with its own shot and spawn delays and its own volleys, which can be turned on and off while
+// the server is running. Group 0 is the main section's, and has every tank and shot that doesn't name a group.
+struct StagedGroup
+{
+    std::string name{"main"};
+    double delayBetweenShots{0.0};
+    double spawnDelay{0.0};
+    bool enabled{true};
+};
+
+struct StagedPlayer
+{
+    bz_eTeamType team{eNoTeam};
+    bool random{false};
+    float pos[3] {0.0f, 0.0f, 0.0f};
+    float rot{0.0f};
+    std::string flag{""};
+
+    // Used for GM shots
+    std::string sectionName{""};
+
+    // The group section named by the tank, and its index in the scene's groups once the scene is planned
+    std::string groupName{""};
+    uint16_t group{0};
+
+    // Only used by the plugin while the scene is running
+    int playerID{-1};
+    double lastDeath{0.0};
+    bool respawnPending{false};
+    bool reloadRespawn{false};
+    bool alive{false};
+
+    // Where the tank first showed up after spawning, and whether it was killed for drifting away from there
+    float driftAnchor[3] {0.0f, 0.0f, 0.0f};
+    bool driftAnchorSet{false};
+    bool driftRespawn{false};
+
+    // How often the tank died and how long the scene was missing it, to find unstable placements
+    unsigned int deaths{0};
+    unsigned int driftKills{0};
+    float maxDrift{0.0f};
+    double diedAt{-1.0};
+    double timeLost{0.0};
+};
+
+struct StagedShot
+{
+    bz_eTeamType team{eNoTeam};
+    float pos[3] {0.0f, 0.0f, 0.0f};
+    float dir[3] {1.0f, 0.0f, 0.0f};
+    std::string flag{""};
+    ShotSpeedClass speedClass{ShotSpeedNormal};
+
+    // Used for GM shots
+    std::string targetPlayerSectionName{""};
+
+    std::string groupName{""};
+    uint16_t group{0};
+
+    // Fire the shot as if it had already been travelling for this many seconds or world units
+    float age{0.0f};
+    float distance{0.0f};
+
+    // Move the shot to just after it has ricocheted off of the world this many times
+    int bounces{0};
+};
+
+// The staged shots as the volley fires them, stored column by column and sorted by speed class, so that firing never
+// has to touch a string or allocate.
+struct ShotTable
+{
+    std::vector<float> pos;
+    std::vector<float> dir;
+    std::vector<bz_eTeamType> team;
+    std::vector<uint16_t> flag;
+
+    // The staged player a GM is aimed at, or -1
+    std::vector<int> target;
+
+    // The bzfs player that is currently staged as the target, kept up to date by the plugin
+    std::vector<int> targetPlayerID;
+
+    // The group each shot belongs to. Each speed class is sorted by group, so a group's shots in it are together.
+    std::vector<uint16_t> group;
+
+    // Shots [classStart[c], classStart[c + 1]) need the shot speed for class c
+    size_t classStart[ShotSpeedClassCount + 1] {0, 0, 0, 0};
+
+    size_t size() const
+    {
+        return team.size();
+    }
+};
+
+class StagedScene
+{
+public:
+    // Load either a configuration file or a scene compiled by stagedSceneCompiler, based on the file extension
+    bool load(const char* fileName);
+
+    bool readConfig(const char* configFile);
+
+    // The original parser on top of bzfs's PluginConfig, kept to check readConfig against. It gives the same scene.
+    bool readPluginConfig(const char* configFile);
+    bool readBinary(const char* sceneFile);
+    bool writeBinary(const char* sceneFile) const;
+
+    static bool isBinary(const char* fileName);
+    static bool isPlaylist(const char* fileName);
+    static bz_eTeamType teamFromString(std::string team);
+
+    // Index of the group with this lowercase name, or -1 if there isn't one
+    int findGroup(const std::string &name) const;
+
+    // Number of _shotSpeed updates that grouping the shots by speed class saves when every group fires a volley
+    int shotSpeedWritesSaved() const;
+
+    // Move the shots with bounces to where they are after ricocheting. Returns how many were solved.
+    bool needsRicochets() const;
+    int solveRicochets(const StagedWorld &world);
+
+    // How far along its direction a shot starts out, from its distance or from its age at the speed it flies at.
+    // Lasers and thief are fired from where they are, so they always start at 0.
+    float startDistance(const StagedShot &stagedShot, const ServerShotSpeeds &speeds) const;
+
+    // Check the placement of the tanks and shots, against the world too if there is one. Returns the number of
+    // conflicts that are left.
+    int validate(const StagedWorld *world, const ServerShotSpeeds &speeds = ServerShotSpeeds());
+
+    SceneModes mode = ModeStatic1;
+    SceneRefireModes refireMode = RefireVolley;
+    size_t maxShots = 255;
+    SceneValidation validation = ValidateReport;
+
+    double shotSpeed = 0.01;
+
+    // How far a tank may drift in the static modes before it is killed, or 0 to kill it as soon as it moves
+    float driftTolerance = 0.0f;
+
+    // File or FIFO to write the generation number to whenever the scene is ready
+    std::string readyFile;
+
+    // CSV or JSON file to write the plugin's stats to every statsInterval seconds
+    std::string statsFile;
+    float statsInterval = 60.0f;
+
+    // File to record the events and shots of the run to, so it can be replayed in the harness
+    std::string recordFile;
+
+    // The main group first, then the group sections in order of their names
+    std::vector<StagedGroup> groups{StagedGroup()};
+
+    std::vector<StagedPlayer> stagedPlayers;
+    std::vector<StagedShot> stagedShots;
+
+    ShotTable shotTable;
+
+    // Flag abbreviations used by the staged shots, indexed by the shot table's flag IDs
+    std::vector<std::string> shotFlags;
+
+private:
+    bool readSection(const SceneSection &section);
+    bool readMain(const SceneSection &section);
+    bool readTank(const SceneSection &section);
+    bool readShot(const SceneSection &section);
+    bool readGroup(const SceneSection &section);
+    bool expandFormation(const SceneSection &section);
+    bool readBounces(const SceneSection &section, StagedShot &shot);
+    void planVolley();
+    uint16_t internFlag(const std::string &flag);
+};
+
+#endif // STAGED_SCENE_H
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
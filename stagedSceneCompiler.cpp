@@ -0,0 +1,145 @@
+// stagedSceneCompiler
+// Compiles a stagedSceneGenerator configuration file into a binary .scene
+// file that the plugin can load without parsing anything. See
+// README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "bzfsAPI.h"
+#include "stagedScene.h"
+#include "stagedWorld.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The scene code reports problems through the bzfs debug log. There is no bzfs here, so send those to the console.
+static int debugLevel = 0;
+
+void bz_debugMessage(int level, const char* message)
+{
+    if (level <= debugLevel)
+        fprintf(stderr, "%s\n", message);
+}
+
+void bz_debugMessagef(int level, const char* fmt, ...)
+{
+    if (level > debugLevel)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+static void usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s [-v] [-w <world file>] <config file> <scene file>\n", program);
+}
+
+int main(int argc, char** argv)
+{
+    const char* configFile = NULL;
+    const char* sceneFile = NULL;
+    const char* worldFile = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-v") == 0)
+            ++debugLevel;
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            worldFile = argv[++i];
+        else if (configFile == NULL)
+            configFile = argv[i];
+        else if (sceneFile == NULL)
+            sceneFile = argv[i];
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (configFile == NULL || sceneFile == NULL)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!StagedScene::isBinary(sceneFile))
+    {
+        fprintf(stderr, "ERROR: The scene file name must end in .scene so the plugin knows to load it as one\n");
+        return EXIT_FAILURE;
+    }
+
+    StagedScene scene;
+    if (!scene.readConfig(configFile))
+        return EXIT_FAILURE;
+
+    // Without the world, the plugin traces the ricochets against the server's world when it loads the scene
+    StagedWorld world;
+    if (worldFile != NULL)
+    {
+        if (!world.readWorldFile(worldFile))
+            return EXIT_FAILURE;
+        world.build();
+
+        if (scene.needsRicochets())
+        {
+            int solved = scene.solveRicochets(world);
+            printf("Traced %d ricocheting shots against %u obstacles in %s\n", solved, (unsigned)world.obstacleCount(), worldFile);
+        }
+    }
+
+    // There's no server to ask here, so aged shots outside of the static modes are checked at the default shot speeds
+    int conflicts = scene.validate(worldFile != NULL ? &world : NULL);
+    if (conflicts > 0)
+        printf("Found %d placement problems, see above\n", conflicts);
+
+    if (!scene.writeBinary(sceneFile))
+        return EXIT_FAILURE;
+
+    printf("Compiled %u tanks and %u shots into %s\n", (unsigned)scene.stagedPlayers.size(),
+           (unsigned)scene.stagedShots.size(), sceneFile);
+
+    return EXIT_SUCCESS;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,322 @@
+// stagedSceneGenerator
+// A single pass reader for scene config files, which hands over one section at a time instead of building up the
+// whole file in memory first. See README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "stagedSceneConfig.h"
+#include "bzfsAPI.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <fstream>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <glob.h>
+#endif
+
+namespace
+{
+// Indexed by SceneKey
+const char* const SceneKeyNames[SceneKeyCount] = {
+    "type", "team", "flag", "random", "pos", "rot", "elev", "target", "age", "distance", "bounces", "group",
+    "of", "layout", "facing", "count", "spacing", "columns", "radius", "heading", "jitter", "rotjitter", "seed",
+    "enabled",
+    "shotdelay", "shotspeed", "spawndelay", "refire", "validate", "drifttolerance", "readyfile", "statsfile",
+    "statsinterval", "recordfile", "maxshots", "mode"
+};
+
+const char* const Whitespace = " \t\r";
+
+// No key is longer than this, so anything longer can be skipped without looking it up
+const size_t MaxKeyLength = 32;
+
+// Include lines are picked out before the key is looked up, so include isn't a SceneKey
+const char* const IncludeKey = "include";
+
+bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool isPathSeparator(char c)
+{
+#ifdef _WIN32
+    return c == '/' || c == '\\';
+#else
+    return c == '/';
+#endif
+}
+
+bool isAbsolute(const std::string &path)
+{
+#ifdef _WIN32
+    if (path.size() > 1 && path[1] == ':')
+        return true;
+#endif
+    return !path.empty() && isPathSeparator(path[0]);
+}
+
+thread_local std::vector<std::string>* heldMessages = NULL;
+}
+
+void sceneError(const char* fmt, ...)
+{
+    char message[512];
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    if (heldMessages != NULL)
+        heldMessages->push_back(std::string("ERROR: ") + message);
+    else
+        bz_debugMessagef(0, "ERROR: %s", message);
+}
+
+SceneMessageHold::SceneMessageHold(std::vector<std::string> &messages) : previous(heldMessages)
+{
+    heldMessages = &messages;
+}
+
+SceneMessageHold::~SceneMessageHold()
+{
+    heldMessages = previous;
+}
+
+void SceneSection::clear()
+{
+    for (int key = 0; key < SceneKeyCount; ++key)
+    {
+        values[key].clear();
+        lines[key] = 0;
+    }
+    present = 0;
+    name.clear();
+    line = 0;
+}
+
+SceneKey SceneSection::keyFromName(const char* name)
+{
+    for (int key = 0; key < SceneKeyCount; ++key)
+    {
+        if (strcmp(name, SceneKeyNames[key]) == 0)
+            return (SceneKey)key;
+    }
+    return SceneKeyCount;
+}
+
+void SceneSection::error(SceneKey key, const char* fmt, ...) const
+{
+    char message[512];
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    int lineNumber = key < SceneKeyCount && lines[key] > 0 ? lines[key] : line;
+    if (fileName != NULL && lineNumber > 0)
+        sceneError("%s:%d: %s", fileName, lineNumber, message);
+    else
+        sceneError("%s", message);
+}
+
+bool readSceneSections(const char* fileName, const std::function<bool(const SceneSection&)> &handleSection,
+                       std::vector<SceneInclude>* includes)
+{
+    std::ifstream file(fileName);
+    if (!file)
+    {
+        sceneError("Unable to open %s", fileName);
+        return false;
+    }
+
+    // The one section is reused for the whole file
+    SceneSection section;
+    section.fileName = fileName;
+
+    // Keys before the first section header go in a section with no name, which is only handed over if there are any
+    bool pending = false;
+
+    std::string text;
+    char key[MaxKeyLength + 1];
+    int lineNumber = 0;
+    while (std::getline(file, text))
+    {
+        ++lineNumber;
+
+        const char* start = text.c_str() + std::min(text.find_first_not_of(Whitespace), text.size());
+        if (*start == '\0' || *start == '#' || *start == ';')
+            continue;
+
+        if (*start == '[')
+        {
+            const char* close = strchr(start + 1, ']');
+            if (close == NULL)
+            {
+                sceneError("%s:%d: The section header is missing a ]", fileName, lineNumber);
+                return false;
+            }
+
+            if (pending && !handleSection(section))
+                return false;
+
+            section.clear();
+            section.name.assign(start + 1, close);
+            for (char &c : section.name)
+                c = (char)tolower((unsigned char)c);
+            section.line = lineNumber;
+            pending = true;
+            continue;
+        }
+
+        const char* equals = strchr(start, '=');
+        if (equals == NULL)
+        {
+            sceneError("%s:%d: Expected a [section] or a key = value", fileName, lineNumber);
+            return false;
+        }
+
+        const char* keyEnd = equals;
+        while (keyEnd > start && isWhitespace(keyEnd[-1]))
+            --keyEnd;
+        if ((size_t)(keyEnd - start) > MaxKeyLength)
+            continue;
+
+        size_t keyLength = 0;
+        for (const char* c = start; c < keyEnd; ++c)
+            key[keyLength++] = (char)tolower((unsigned char)*c);
+        key[keyLength] = '\0';
+
+        const char* valueStart = equals + 1;
+        const char* valueEnd = text.c_str() + text.size();
+        while (valueStart < valueEnd && isWhitespace(*valueStart))
+            ++valueStart;
+        while (valueEnd > valueStart && isWhitespace(valueEnd[-1]))
+            --valueEnd;
+
+        if (includes != NULL && strcmp(key, IncludeKey) == 0)
+        {
+            if (valueStart == valueEnd)
+            {
+                sceneError("%s:%d: The include is missing a file name", fileName, lineNumber);
+                return false;
+            }
+            includes->push_back({std::string(valueStart, valueEnd), lineNumber});
+            continue;
+        }
+
+        SceneKey sceneKey = SceneSection::keyFromName(key);
+        if (sceneKey == SceneKeyCount)
+            continue;
+
+        // Include lines and unknown keys alone don't make a section with no name
+        pending = true;
+        section.values[sceneKey].assign(valueStart, valueEnd);
+        section.lines[sceneKey] = lineNumber;
+        section.present |= (uint64_t)1 << sceneKey;
+    }
+
+    if (file.bad())
+    {
+        sceneError("%s:%d: Unable to read any further", fileName, lineNumber);
+        return false;
+    }
+
+    return !pending || handleSection(section);
+}
+
+bool expandSceneInclude(const std::string &includingFile, const std::string &pattern, std::vector<std::string> &files)
+{
+    std::string path = pattern;
+    if (!isAbsolute(pattern))
+    {
+        size_t separator = includingFile.size();
+        while (separator > 0 && !isPathSeparator(includingFile[separator - 1]))
+            --separator;
+        path = includingFile.substr(0, separator) + pattern;
+    }
+
+    if (path.find_first_of("*?") == std::string::npos)
+    {
+        files.push_back(path);
+        return true;
+    }
+
+    size_t found = files.size();
+
+#ifdef _WIN32
+    size_t separator = path.size();
+    while (separator > 0 && !isPathSeparator(path[separator - 1]))
+        --separator;
+    const std::string directory = path.substr(0, separator);
+
+    WIN32_FIND_DATAA match;
+    HANDLE search = FindFirstFileA(path.c_str(), &match);
+    if (search != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if ((match.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+                files.push_back(directory + match.cFileName);
+        }
+        while (FindNextFileA(search, &match));
+        FindClose(search);
+    }
+#else
+    glob_t matches;
+    if (glob(path.c_str(), 0, NULL, &matches) == 0)
+    {
+        for (size_t i = 0; i < matches.gl_pathc; ++i)
+            files.push_back(matches.gl_pathv[i]);
+    }
+    globfree(&matches);
+#endif
+
+    std::sort(files.begin() + found, files.end());
+    return files.size() > found;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,183 @@
+// stagedSceneGenerator
+// A single pass reader for scene config files, which hands over one section at a time instead of building up the
+// whole file in memory first. See README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#ifndef STAGED_SCENE_CONFIG_H
+#define STAGED_SCENE_CONFIG_H
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Every key a section of a scene config can use. Any other key is ignored.
+enum SceneKey {
+    KeyType,
+    KeyTeam,
+    KeyFlag,
+    KeyRandom,
+    KeyPos,
+    KeyRot,
+    KeyElev,
+    KeyTarget,
+    KeyAge,
+    KeyDistance,
+    KeyBounces,
+    KeyGroup,
+
+    // Formations
+    KeyOf,
+    KeyLayout,
+    KeyFacing,
+    KeyCount,
+    KeySpacing,
+    KeyColumns,
+    KeyRadius,
+    KeyHeading,
+    KeyJitter,
+    KeyRotJitter,
+    KeySeed,
+
+    // Groups, which also take ShotDelay and SpawnDelay
+    KeyEnabled,
+
+    // The main section
+    KeyShotDelay,
+    KeyShotSpeed,
+    KeySpawnDelay,
+    KeyRefire,
+    KeyValidate,
+    KeyDriftTolerance,
+    KeyReadyFile,
+    KeyStatsFile,
+    KeyStatsInterval,
+    KeyRecordFile,
+    KeyMaxShots,
+    KeyMode,
+
+    SceneKeyCount
+};
+
+// One section of a config, with the value of each key it set and the line it was set on. A key that wasn't set is
+// empty, the same as PluginConfig::item() gives back.
+struct SceneSection
+{
+    // Clears the values but keeps their memory, so reading the next section doesn't allocate
+    void clear();
+
+    const std::string& item(SceneKey key) const
+    {
+        return values[key];
+    }
+
+    // Whether the key was there at all, even with an empty value
+    bool has(SceneKey key) const
+    {
+        return (present >> key) & 1;
+    }
+
+    void set(SceneKey key, const std::string &value, int lineNumber = 0)
+    {
+        values[key] = value;
+        lines[key] = lineNumber;
+        present |= (uint64_t)1 << key;
+    }
+
+    // The key with this lowercase name, or SceneKeyCount if there isn't one
+    static SceneKey keyFromName(const char* name);
+
+    // Logs an error about a key, or about the whole section for SceneKeyCount, with the file and line it came from
+    // when those are known
+    void error(SceneKey key, const char* fmt, ...) const
+#ifdef __GNUC__
+        __attribute__((format(printf, 3, 4)))
+#endif
+        ;
+
+    // Lowercase, like PluginConfig
+    std::string name;
+    const char* fileName = NULL;
+    int line = 0;
+
+    std::string values[SceneKeyCount];
+    int lines[SceneKeyCount] = {};
+    uint64_t present = 0;
+};
+
+// An include line, which can be anywhere in a file and doesn't belong to the section it is in
+struct SceneInclude
+{
+    std::string pattern;
+    int line;
+};
+
+// Reads a config file line by line with the same rules as PluginConfig: section names and keys are lowercased,
+// values are trimmed, and lines starting with # or ; are comments. Each section is handed to handleSection as soon
+// as the next one starts, in the order they are in the file. Include lines are added to includes, or ignored if
+// that is NULL. Returns false with the line number logged for a line that can't be read, or as soon as
+// handleSection returns false.
+bool readSceneSections(const char* fileName, const std::function<bool(const SceneSection&)> &handleSection,
+                       std::vector<SceneInclude>* includes = NULL);
+
+// Turns an include pattern into the files it names, in sorted order. A relative pattern is relative to the
+// directory of the file it is in, and the last part of it can have * and ? wildcards.
+bool expandSceneInclude(const std::string &includingFile, const std::string &pattern, std::vector<std::string> &files);
+
+// Logs "ERROR: " and the message, or keeps it if a SceneMessageHold is around on this thread
+void sceneError(const char* fmt, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 1, 2)))
+#endif
+    ;
+
+// The bzfs log isn't safe to write to from other threads, so while one of these is around, the errors from reading
+// a config on this thread are kept in messages to be logged later
+class SceneMessageHold
+{
+public:
+    explicit SceneMessageHold(std::vector<std::string> &messages);
+    ~SceneMessageHold();
+
+private:
+    std::vector<std::string>* previous;
+};
+
+#endif // STAGED_SCENE_CONFIG_H
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
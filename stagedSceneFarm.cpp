@@ -0,0 +1,615 @@
+// stagedSceneFarm
+// Splits a playlist across several bzfs servers on this machine, one per core
+// by default, and collects how each of them did. See
+// README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FarmScene
+{
+    std::string fileName;
+    double duration;
+};
+
+// One bzfs server and the slice of the playlist it shows
+struct FarmServer
+{
+    int number = 0;
+    int port = 0;
+    std::vector<FarmScene> scenes;
+    double duration = 0.0;
+
+    std::string playlistFile;
+    std::string readyFile;
+    std::string statsFile;
+    std::string logFile;
+
+    pid_t pid = -1;
+    bool exited = false;
+    int status = 0;
+
+    // Everything bzfs prints goes to the log, and the plugin's lines are picked out of it on the way
+    int output = -1;
+    std::string outputLine;
+    FILE* log = NULL;
+
+    // The ready FIFO. The farm keeps it open for writing too, so it doesn't read as hung up between scenes.
+    int ready = -1;
+    int readyWriter = -1;
+    std::string readyLine;
+
+    std::string currentScene;
+    unsigned readyCount = 0;
+    unsigned generation = 0;
+
+    // From the plugin's report once the playlist is done
+    bool finished = false;
+    unsigned shown = 0;
+    double elapsed = 0.0;
+    double perHour = 0.0;
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int)
+{
+    stopRequested = 1;
+}
+
+static void usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s [-n <servers>] [-p <first port>] [-b <bzfs>] [-l <plugin>] [-o <directory>] <playlist> "
+                    "[-- <bzfs options>]\n", program);
+}
+
+static std::string trimmed(const std::string &text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return "";
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+static std::string absolutePath(const std::string &path)
+{
+    if (!path.empty() && path[0] == '/')
+        return path;
+
+    char directory[4096];
+    if (getcwd(directory, sizeof(directory)) == NULL)
+        return path;
+    return std::string(directory) + "/" + path;
+}
+
+// The same format the plugin reads, with every scene made absolute since the servers get their playlists from
+// another directory. The playlist's own ReadyFile and StatsFile are replaced with the farm's.
+static bool readPlaylist(const char* fileName, std::vector<FarmScene> &scenes)
+{
+    std::ifstream file(fileName);
+    if (!file)
+    {
+        fprintf(stderr, "ERROR: Unable to open the playlist %s\n", fileName);
+        return false;
+    }
+
+    std::string directory = absolutePath(fileName);
+    directory.erase(directory.find_last_of('/') + 1);
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); ++lineNumber)
+    {
+        std::istringstream fields(line);
+        FarmScene scene;
+        if (!(fields >> scene.duration))
+        {
+            std::string first;
+            std::istringstream blank(line);
+            if (!(blank >> first) || first[0] == '#')
+                continue;
+
+            if (line.find('=') != std::string::npos)
+            {
+                fprintf(stderr, "WARNING: Line %d of the playlist %s is replaced by the farm's own files\n", lineNumber,
+                        fileName);
+                continue;
+            }
+
+            fprintf(stderr, "ERROR: Line %d of the playlist %s doesn't start with a duration\n", lineNumber, fileName);
+            return false;
+        }
+
+        std::getline(fields >> std::ws, scene.fileName);
+        scene.fileName = trimmed(scene.fileName);
+        if (scene.duration <= 0.0 || scene.fileName.empty())
+        {
+            fprintf(stderr, "ERROR: Line %d of the playlist %s needs a positive duration and a scene file\n",
+                    lineNumber, fileName);
+            return false;
+        }
+
+        if (scene.fileName[0] != '/')
+            scene.fileName = directory + scene.fileName;
+
+        // The server skips a scene it can't load, so this is only a warning
+        if (access(scene.fileName.c_str(), R_OK) != 0)
+            fprintf(stderr, "WARNING: Line %d of the playlist %s: %s can't be read\n", lineNumber, fileName,
+                    scene.fileName.c_str());
+
+        scenes.push_back(scene);
+    }
+
+    if (scenes.empty())
+    {
+        fprintf(stderr, "ERROR: The playlist %s has no scenes\n", fileName);
+        return false;
+    }
+    return true;
+}
+
+// Each server gets the next run of scenes in the playlist until it has about its share of the total time, so the
+// servers finish around the same time and scenes that were next to each other stay together
+static std::vector<FarmServer> splitPlaylist(const std::vector<FarmScene> &scenes, int servers)
+{
+    double total = 0.0;
+    for (const FarmScene &scene : scenes)
+        total += scene.duration;
+
+    std::vector<FarmServer> farm(1);
+    double assigned = 0.0;
+    for (const FarmScene &scene : scenes)
+    {
+        if ((int)farm.size() < servers && !farm.back().scenes.empty()
+            && assigned + scene.duration / 2.0 > total * farm.size() / servers)
+            farm.push_back(FarmServer());
+
+        farm.back().scenes.push_back(scene);
+        farm.back().duration += scene.duration;
+        assigned += scene.duration;
+    }
+
+    return farm;
+}
+
+static bool writeServerPlaylist(const FarmServer &server, size_t servers)
+{
+    std::ofstream out(server.playlistFile.c_str());
+    out << "# Written by stagedSceneFarm for server " << server.number << " of " << servers << " on port "
+        << server.port << "\n";
+    out << "ReadyFile = " << server.readyFile << "\n";
+    out << "StatsFile = " << server.statsFile << "\n";
+    for (const FarmScene &scene : server.scenes)
+        out << scene.duration << " " << scene.fileName << "\n";
+
+    if (!out)
+    {
+        fprintf(stderr, "ERROR: Unable to write the playlist %s\n", server.playlistFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool openReadyFile(FarmServer &server)
+{
+    unlink(server.readyFile.c_str());
+    if (mkfifo(server.readyFile.c_str(), 0644) != 0)
+    {
+        fprintf(stderr, "ERROR: Unable to make the FIFO %s: %s\n", server.readyFile.c_str(), strerror(errno));
+        return false;
+    }
+
+    // Everything the farm opens is closed on exec, so each bzfs only gets its own output pipe
+    server.ready = open(server.readyFile.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    server.readyWriter = open(server.readyFile.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (server.ready < 0 || server.readyWriter < 0)
+    {
+        fprintf(stderr, "ERROR: Unable to open the FIFO %s: %s\n", server.readyFile.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static bool startServer(FarmServer &server, const std::string &bzfs, const std::string &plugin,
+                        const std::vector<std::string> &options)
+{
+    server.log = fopen(server.logFile.c_str(), "we");
+    if (server.log == NULL)
+    {
+        fprintf(stderr, "ERROR: Unable to write the log %s\n", server.logFile.c_str());
+        return false;
+    }
+
+    // The plugin's INFO lines need -d, and the options are the ones the README asks for
+    std::vector<std::string> args = { bzfs, "-p", std::to_string(server.port), "-noTeamKills", "-ms", "0", "-d",
+                                      "-loadplugin", plugin + "," + server.playlistFile };
+    args.insert(args.end(), options.begin(), options.end());
+
+    int pipes[2];
+    if (pipe2(pipes, O_CLOEXEC) != 0)
+    {
+        fprintf(stderr, "ERROR: Unable to make a pipe: %s\n", strerror(errno));
+        return false;
+    }
+
+    server.pid = fork();
+    if (server.pid < 0)
+    {
+        fprintf(stderr, "ERROR: Unable to start a server: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (server.pid == 0)
+    {
+        dup2(pipes[1], STDOUT_FILENO);
+        dup2(pipes[1], STDERR_FILENO);
+        close(pipes[0]);
+        close(pipes[1]);
+
+        std::vector<char*> argv;
+        for (std::string &arg : args)
+            argv.push_back(&arg[0]);
+        argv.push_back(NULL);
+
+        execvp(argv[0], argv.data());
+        fprintf(stderr, "ERROR: Unable to run %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+
+    close(pipes[1]);
+    server.output = pipes[0];
+    fcntl(server.output, F_SETFL, O_NONBLOCK);
+    return true;
+}
+
+// Picks out the plugin's own lines about which scene is up and how the playlist went
+static void handleOutputLine(FarmServer &server, const std::string &line)
+{
+    size_t found;
+    if ((found = line.find("INFO: Loaded ")) != std::string::npos)
+        server.currentScene = line.substr(found + 13, line.rfind(" in ") - found - 13);
+    else if ((found = line.find("INFO: Holding ")) != std::string::npos)
+        server.currentScene = line.substr(found + 14, line.rfind(" until ") - found - 14);
+    else if ((found = line.find("INFO: Playlist showed ")) != std::string::npos)
+    {
+        unsigned total = 0;
+        sscanf(line.c_str() + found, "INFO: Playlist showed %u of %u scenes in %lf seconds (%lf", &server.shown, &total,
+               &server.elapsed, &server.perHour);
+    }
+    else if (line.find("INFO: Playlist finished") != std::string::npos)
+    {
+        server.finished = true;
+        printf("Server %d on port %d finished: showed %u of %u scenes in %.1f seconds\n", server.number, server.port,
+               server.shown, (unsigned)server.scenes.size(), server.elapsed);
+        kill(server.pid, SIGTERM);
+    }
+    else if (line.find("ERROR:") != std::string::npos || line.find("WARNING:") != std::string::npos)
+        printf("Server %d: %s\n", server.number, line.c_str());
+}
+
+static void readOutput(FarmServer &server)
+{
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(server.output, buffer, sizeof(buffer))) > 0)
+    {
+        fwrite(buffer, 1, count, server.log);
+        server.outputLine.append(buffer, count);
+
+        size_t start = 0, end;
+        while ((end = server.outputLine.find('\n', start)) != std::string::npos)
+        {
+            handleOutputLine(server, server.outputLine.substr(start, end - start));
+            start = end + 1;
+        }
+        server.outputLine.erase(0, start);
+    }
+
+    // The server is gone once nothing has the other end open. Any other error would keep waking poll up.
+    if (count == 0 || (errno != EAGAIN && errno != EINTR))
+    {
+        if (count < 0)
+            printf("Server %d: Unable to read its output: %s\n", server.number, strerror(errno));
+
+        close(server.output);
+        server.output = -1;
+        fclose(server.log);
+        server.log = NULL;
+    }
+}
+
+// The plugin writes the generation number each time the scene is ready
+static void readReady(FarmServer &server)
+{
+    char buffer[256];
+    ssize_t count;
+    while ((count = read(server.ready, buffer, sizeof(buffer))) > 0)
+    {
+        server.readyLine.append(buffer, count);
+
+        size_t end;
+        while ((end = server.readyLine.find('\n')) != std::string::npos)
+        {
+            server.generation = (unsigned)strtoul(server.readyLine.c_str(), NULL, 10);
+            server.readyLine.erase(0, end + 1);
+            ++server.readyCount;
+            printf("Server %d on port %d: %s is ready (generation %u)\n", server.number, server.port,
+                   server.currentScene.c_str(), server.generation);
+        }
+    }
+
+    // The farm holds the FIFO open for writing as well, so it never reaches the end, but it can fail
+    if (count < 0 && errno != EAGAIN && errno != EINTR)
+    {
+        printf("Server %d: Unable to read %s: %s\n", server.number, server.readyFile.c_str(), strerror(errno));
+        close(server.ready);
+        server.ready = -1;
+    }
+}
+
+static void reapServers(std::vector<FarmServer> &farm)
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        for (FarmServer &server : farm)
+        {
+            if (server.pid != pid)
+                continue;
+
+            server.exited = true;
+            server.status = status;
+            if (!server.finished)
+                printf("Server %d on port %d stopped before its playlist finished, see %s\n", server.number,
+                       server.port, server.logFile.c_str());
+        }
+    }
+}
+
+static bool writeResults(const std::vector<FarmServer> &farm, const std::string &fileName)
+{
+    std::ofstream out(fileName.c_str());
+    out << "server,port,scenes,planned_seconds,shown,seconds,scenes_per_hour,ready,finished,exit_status,playlist,log,"
+           "stats\n";
+    for (const FarmServer &server : farm)
+    {
+        int exitStatus = WIFEXITED(server.status) ? WEXITSTATUS(server.status) : -WTERMSIG(server.status);
+        out << server.number << "," << server.port << "," << server.scenes.size() << "," << server.duration << ","
+            << server.shown << "," << server.elapsed << "," << server.perHour << "," << server.readyCount << ","
+            << (server.finished ? "yes" : "no") << "," << exitStatus << "," << server.playlistFile << ","
+            << server.logFile << "," << server.statsFile << "\n";
+    }
+    return (bool)out;
+}
+
+int main(int argc, char** argv)
+{
+    // One server per core, or just one if the number of cores isn't known
+    int servers = std::max(1, (int)std::thread::hardware_concurrency());
+    int firstPort = 5154;
+    std::string bzfs = "bzfs";
+    std::string plugin = "stagedSceneGenerator";
+    std::string directory = "stagedSceneFarm";
+    const char* playlistFile = NULL;
+    std::vector<std::string> options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            servers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            firstPort = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            bzfs = argv[++i];
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            plugin = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            directory = argv[++i];
+        else if (strcmp(argv[i], "--") == 0)
+        {
+            options.assign(argv + i + 1, argv + argc);
+            break;
+        }
+        else if (playlistFile == NULL && argv[i][0] != '-')
+            playlistFile = argv[i];
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (playlistFile == NULL || servers < 1 || firstPort < 1 || firstPort > 65535)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<FarmScene> scenes;
+    if (!readPlaylist(playlistFile, scenes))
+        return EXIT_FAILURE;
+
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "ERROR: Unable to make the directory %s: %s\n", directory.c_str(), strerror(errno));
+        return EXIT_FAILURE;
+    }
+    directory = absolutePath(directory) + "/";
+
+    std::vector<FarmServer> farm = splitPlaylist(scenes, servers);
+    if (firstPort + (int)farm.size() - 1 > 65535)
+    {
+        fprintf(stderr, "ERROR: There aren't %u ports from %d\n", (unsigned)farm.size(), firstPort);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < farm.size(); ++i)
+    {
+        FarmServer &server = farm[i];
+        server.number = (int)i + 1;
+        server.port = firstPort + (int)i;
+
+        const std::string name = directory + "server" + std::to_string(server.number);
+        server.playlistFile = name + ".playlist";
+        server.readyFile = name + ".ready";
+        server.statsFile = name + ".stats.json";
+        server.logFile = name + ".log";
+        if (!writeServerPlaylist(server, farm.size()) || !openReadyFile(server))
+            return EXIT_FAILURE;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    for (FarmServer &server : farm)
+    {
+        if (!startServer(server, bzfs, plugin, options))
+        {
+            stopRequested = 1;
+            break;
+        }
+        printf("Server %d on port %d is showing %u scenes (%.0f seconds)\n", server.number, server.port,
+               (unsigned)server.scenes.size(), server.duration);
+    }
+
+    // Each server's playlist starts once the bots have joined and its first scene is ready
+    bool stopping = false;
+    for (;;)
+    {
+        if (stopRequested && !stopping)
+        {
+            stopping = true;
+            printf("Stopping the servers\n");
+            for (FarmServer &server : farm)
+            {
+                if (server.pid > 0 && !server.exited)
+                    kill(server.pid, SIGTERM);
+            }
+        }
+
+        std::vector<pollfd> watched;
+        std::vector<FarmServer*> owners;
+        for (FarmServer &server : farm)
+        {
+            if (server.output >= 0)
+            {
+                watched.push_back({ server.output, POLLIN, 0 });
+                owners.push_back(&server);
+            }
+            if (server.ready >= 0 && server.output >= 0)
+            {
+                watched.push_back({ server.ready, POLLIN, 0 });
+                owners.push_back(&server);
+            }
+        }
+        if (watched.empty())
+            break;
+
+        if (poll(watched.data(), watched.size(), 1000) < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "ERROR: Unable to wait on the servers: %s\n", strerror(errno));
+            stopRequested = 1;
+        }
+
+        for (size_t i = 0; i < watched.size(); ++i)
+        {
+            if (watched[i].revents == 0)
+                continue;
+            if (watched[i].fd == owners[i]->ready)
+                readReady(*owners[i]);
+            else
+                readOutput(*owners[i]);
+        }
+
+        reapServers(farm);
+    }
+
+    // The output closes just before the server exits, so wait for the rest of them
+    for (FarmServer &server : farm)
+    {
+        if (server.pid > 0 && !server.exited && waitpid(server.pid, &server.status, 0) == server.pid)
+            server.exited = true;
+        if (server.ready >= 0)
+            readReady(server);
+        if (server.ready >= 0)
+            close(server.ready);
+        close(server.readyWriter);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    unsigned shown = 0, finished = 0;
+    for (const FarmServer &server : farm)
+    {
+        shown += server.shown;
+        finished += server.finished ? 1 : 0;
+    }
+
+    const std::string resultsFile = directory + "results.csv";
+    if (!writeResults(farm, resultsFile))
+        fprintf(stderr, "ERROR: Unable to write the results to %s\n", resultsFile.c_str());
+
+    printf("%u of %u servers finished, showing %u of %u scenes in %.1f seconds (%.0f scenes per hour)\n", finished,
+           (unsigned)farm.size(), shown, (unsigned)scenes.size(), elapsed, elapsed > 0.0 ? shown * 3600.0 / elapsed : 0.0);
+    printf("Results are in %s\n", resultsFile.c_str());
+
+    return finished == farm.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -34,10 +34,33 @@ either expressed or implied, of the FreeBSD Project.
 
 #include "bzfsAPI.h"
 #include "plugin_utils.h"
-
+#include "stagedLog.h"
+#include "stagedRecorder.h"
+#include "stagedScene.h"
+#include "stagedStats.h"
+#include "stagedWorld.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <errno.h>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
 #include <math.h>
+#include <queue>
+#include <sstream>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <vector>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 class stagedSceneGenerator : public bz_Plugin, public bz_CustomSlashCommandHandler
 {
 public:
@@ -51,64 +74,233 @@ public:
     virtual bool SlashCommand ( int playerID, bz_ApiString, bz_ApiString, bz_APIStringList*);
 
 private:
-    bool readConfig(const char* configFile);
-    bz_eTeamType teamFromString(std::string team);
+    void advanceShots();
+    ServerShotSpeeds serverShotSpeeds() const;
+    void buildPlayerIndex();
+    void prepareScene(StagedScene &staged);
 
-    PluginConfig config;
+    bool loadScene(int playerID, const std::string &fileName);
+    void applyScene(StagedScene &next);
+    void reportShotSpeedWrites() const;
+    void adoptParkedBot(size_t slot);
 
-    struct StagedPlayer
-    {
-        bz_eTeamType team{eNoTeam};
-        bool random{false};
-        float pos[3] {0.0f, 0.0f, 0.0f};
-        float rot{0.0f};
-        std::string flag{""};
+    bool readPlaylist(const std::string &fileName);
+    bool loadStartupPlaylist();
+    void usePlaylistFiles(StagedScene &next) const;
+    void startPlaylist(int playerID, double now);
+    void nextPlaylistScene(double now);
+    void stopPlaylist(double now);
+    void reportPlaylist(int playerID, double now);
+
+    void scheduleStatsDump(double now);
+    void dumpStats(double now);
+
+    bool isSceneReady(double now) const;
+    void updateReadiness(double now);
+    void signalReadyFile();
+
+    StagedScene scene;
+
+    // What the plugin costs the server, dumped to the scene's StatsFile every StatsInterval seconds if there is one
+    SceneStats stats;
+    double nextStatsDump = -1.0;
+
+    // Messages from the event handlers, written out at the end of each tick
+    SceneLog log;
 
-        int playerID{-1};
+    // Every event and shot of the run, when the scene has a RecordFile
+    SceneRecorder recorder;
 
-        // Used for GM shots
-        std::string sectionName{""};
+    // The server's obstacles, only read in once a scene has shots that ricochet
+    StagedWorld world;
+    bool worldBuilt = false;
 
-        double lastDeath{0.0};
+    // Plugins load before the world does, so the first scene is traced and checked against it on the first tick
+    bool worldPending = false;
+
+    // The file the scene was last loaded from, for /scene reload
+    std::string sceneFile;
+
+    // Bots that lost their staged player when a scene was reloaded and there was nothing left on their team to take
+    // over. They are kept dead until a staged player on their team frees up.
+    std::vector<int> parkedBots;
+
+    // Time it takes from /scene load until every moved tank has respawned
+    std::chrono::steady_clock::time_point reloadStarted;
+    int reloadRequestedBy = BZ_SERVER;
+    size_t reloadRespawnsPending = 0;
+
+    // A playlist steps through a list of scenes, holding each one for a number of seconds
+    struct PlaylistEntry
+    {
+        std::string fileName;
+        double duration;
     };
 
-    std::vector<StagedPlayer> stagedPlayers;
+    std::vector<PlaylistEntry> playlist;
+    size_t playlistPosition = 0;
+
+    // The ReadyFile and StatsFile a playlist sets for every scene it shows, which take over from the scenes' own
+    std::string playlistReadyFile;
+    std::string playlistStatsFile;
+
+    // A playlist from the command line holds its first scene until it's ready before starting the clock
+    bool playlistWaiting = false;
+    int playlistRequestedBy = BZ_SERVER;
+    double playlistStarted = 0.0;
+    double nextSceneAt = -1.0;
+    size_t scenesShown = 0;
+
+    // Every time all of the staged tanks are alive and the staged shots are in flight, the scene is announced as
+    // ready with a new generation number so capture scripts know when to start
+    bool sceneReady = false;
+    unsigned int readyGeneration = 0;
 
-    struct StagedShot
+    // Index of the staged player assigned to each bzfs player ID, or -1 if the player isn't staged
+    std::vector<int> slotByPlayerID;
+
+    // Staged players that are waiting for a player to be assigned, lowest index first so that they fill up in the
+    // same order as the configuration file
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> freeSlots;
+
+    // For each staged player, the staged shots (GMs) that use it as their target
+    std::vector<std::vector<size_t>> shotsTargetingSlot;
+
+    int findSlot(int playerID) const
+    {
+        if (playerID < 0 || playerID >= (int)slotByPlayerID.size())
+            return -1;
+        return slotByPlayerID[playerID];
+    }
+    void assignSlot(size_t slot, int playerID);
+    void releaseSlot(size_t slot);
+
+    void setShotSpeed(double speed);
+    void refreshBZDBValue(const std::string &key, double value);
+
+    void fireVolley(size_t group, double now);
+    void refireShots(double now);
+    void resetShotPool();
+    double shotLifetime(int speedClass) const;
+    void trackCoverage(double now);
+    void updatePopulated();
+
+    void setGroupEnabled(size_t group, bool enabled, double now);
+    void holdTank(size_t slot);
+    void reportGroups(int playerID, double now);
+
+    void scheduleVolley(size_t group);
+    void scheduleRespawn(size_t slot);
+    void rebuildSchedule(double now);
+    void runDeadlines(double now);
+    void updateWaitTime(double now);
+
+    double spawnDelay(size_t slot) const
     {
-        bz_eTeamType team{eNoTeam};
-        float pos[3] {0.0f, 0.0f, 0.0f};
-        float dir[3] {1.0f, 0.0f, 0.0f};
-        std::string flag{""};
+        return scene.groups[scene.stagedPlayers[slot].group].spawnDelay;
+    }
 
-        // Used for GM shots
-        std::string targetPlayerSectionName{""};
-        int targetPlayerID{-1};
+    // Each group of the scene fires its volleys on its own schedule
+    struct GroupSchedule
+    {
+        double lastShotsFired = -9999.0;
+        double nextShotsFired = 0.0;
+        double populatedUntil = 0.0;
+        size_t shotCount = 0;
     };
 
-    std::vector<StagedShot> stagedShots;
+    std::vector<GroupSchedule> groupSchedules;
+
+    // Staged shots in the groups that are turned on
+    size_t enabledShots = 0;
 
-    double lastShotsFired = -9999.0;
-    double delayBetweenShots = 0.0;
-    double spawnDelay = 0.0;
+    // Continuous refire pool. Shots that are not in flight wait in line for a free slot.
+    std::deque<uint32_t> waitingShots;
+    std::vector<double> shotExpires;
+    std::vector<uint32_t> dueShots;
+    size_t activeShots = 0;
 
-    double shotSpeed = 0.01;
+    // Shots from before the scene was reloaded keep their slots until they expire, so a reload never has more than
+    // MaxShots in flight
+    std::vector<double> carriedExpires;
+    size_t carriedShots = 0;
+
+    // How long the scene has had every shot that it can in flight, for /scene shots
+    double populatedUntil = 0.0;
+    double coverageLastTime = -1.0;
+    double coverageObserved = 0.0;
+    double coveragePopulated = 0.0;
 
     double laserShotSpeed;
     double thiefShotSpeed;
 
-    enum Modes {
-        ModeStatic1,
-        ModeStatic2,
-        ModeStatic3,
-        ModeNormal
+    // BZDB values used by the event handlers. These are read in Init and then only refreshed when a bz_eBZDBChange
+    // event comes in for them, so the tick never has to look them up.
+    double reloadTime = 3.5;
+    double explodeTime = 5.0;
+
+    // The server's own shot speed and laser/thief lifetime multipliers, before the static modes change them
+    double baseShotSpeed = 100.0;
+    double laserAdLife = 0.1;
+    double thiefAdLife = 0.05;
+
+    // Set while the volley changes _shotSpeed so we don't mistake our own change for one made by an admin
+    bool changingShotSpeed = false;
+
+    // Upcoming times that something needs to happen at, so that MaxWaitTime can wake the server up right when the
+    // earliest one is due instead of having it poll. Entries are not removed when they are superseded, so they are
+    // checked against the current state when they come off the heap.
+    enum DeadlineType {
+        DeadlineVolley,
+        DeadlineRespawn,
+        DeadlineShotExpiry,
+        DeadlineCarriedShot,
+        DeadlinePlaylist,
+        DeadlineStatsDump
+    };
+
+    struct Deadline
+    {
+        double time;
+        DeadlineType type;
+        size_t slot;
+
+        bool operator>(const Deadline &other) const
+        {
+            return time > other.time;
+        }
     };
 
-    Modes mode = ModeStatic1;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines;
+
+    bool isCurrent(const Deadline &deadline) const
+    {
+        if (deadline.type == DeadlineVolley)
+            return scene.groups[deadline.slot].enabled && deadline.time == groupSchedules[deadline.slot].nextShotsFired;
+        if (deadline.type == DeadlineShotExpiry)
+            return deadline.time == shotExpires[deadline.slot];
+        if (deadline.type == DeadlineCarriedShot)
+            return deadline.time == carriedExpires[deadline.slot];
+        if (deadline.type == DeadlinePlaylist)
+            return deadline.time == nextSceneAt;
+        if (deadline.type == DeadlineStatsDump)
+            return deadline.time == nextStatsDump;
+        const StagedPlayer &stagedPlayer = scene.stagedPlayers[deadline.slot];
+        return stagedPlayer.respawnPending && deadline.time == stagedPlayer.lastDeath + explodeTime + spawnDelay(deadline.slot);
+    }
+
 };
 
 BZ_PLUGIN(stagedSceneGenerator)
 
+static std::string trimmed(const std::string &text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return "";
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
 void stagedSceneGenerator::Init ( const char* commandLine )
 {
     // Cheap hack to detect if the plugin is being loaded from /loadplugin in-game
@@ -120,6 +312,7 @@ void stagedSceneGenerator::Init ( const char* commandLine )
     }
 
     bz_debugMessage(4,"stagedSceneGenerator plugin loaded");
+    log.setLevel(bz_getDebugLevel());
 
     // A configuration file is required
     if (commandLine == NULL || strlen(commandLine) == 0)
@@ -131,13 +324,31 @@ void stagedSceneGenerator::Init ( const char* commandLine )
     else
     {
         // Try to read the configuration file
-        if (!readConfig(commandLine))
+        sceneFile = commandLine;
+        bool loaded;
+        if (StagedScene::isPlaylist(commandLine))
+            loaded = readPlaylist(sceneFile) && loadStartupPlaylist();
+        else
+            loaded = scene.load(commandLine);
+        if (!loaded)
         {
             bz_debugMessage(0, "ERROR: There was an error reading the provided stagedSceneGenerator config file");
             bz_shutdown();
             return;
         }
 
+        // A replay of a recording starts the plugin with the same server values and time as this run
+        const double startTime = bz_getCurrentTime();
+        double serverValues[ServerValueCount];
+        for (int i = 0; i < ServerValueCount; ++i)
+            serverValues[i] = bz_getBZDBDouble(SceneRecorder::serverVariable(i));
+
+        buildPlayerIndex();
+        resetShotPool();
+        worldPending = true;
+
+        reportShotSpeedWrites();
+
         // init events here with Register();
         Register(bz_eGetAutoTeamEvent);
         Register(bz_eGetPlayerSpawnPosEvent);
@@ -146,6 +357,7 @@ void stagedSceneGenerator::Init ( const char* commandLine )
         Register(bz_ePlayerUpdateEvent);
         Register(bz_ePlayerPartEvent);
         Register(bz_eTickEvent);
+        Register(bz_eBZDBChange);
 
         // Allow bots
         bz_updateBZDBBool("_disableBots", false);
@@ -155,12 +367,15 @@ void stagedSceneGenerator::Init ( const char* commandLine )
 
         // Calculate the laser/thief shot speed (which uses the normal values of _shotSpeed and _laserAdLife before
         // we mess with them below). Because we set the
-        laserShotSpeed = bz_getBZDBDouble("_shotSpeed") * bz_getBZDBDouble("_laserAdLife");
-        thiefShotSpeed = bz_getBZDBDouble("_shotSpeed") * bz_getBZDBDouble("_thiefAdLife");
+        baseShotSpeed = bz_getBZDBDouble("_shotSpeed");
+        laserAdLife = bz_getBZDBDouble("_laserAdLife");
+        thiefAdLife = bz_getBZDBDouble("_thiefAdLife");
+        laserShotSpeed = baseShotSpeed * laserAdLife;
+        thiefShotSpeed = baseShotSpeed * thiefAdLife;
 
         // Mode Static1 - Very low gravity and tanks spawn slightly in the air.
         // Tank speed is still normal, so it's possible to move as observer
-        if (mode == ModeStatic1)
+        if (scene.mode == ModeStatic1)
         {
             bz_updateBZDBDouble("_gravity", -0.000001);
 
@@ -170,16 +385,16 @@ void stagedSceneGenerator::Init ( const char* commandLine )
 
         // Mode Static2 or Static3 - Very low tank speed and turning velocity. Normal gravity. Can't drive as observer
         // and must use /roampos to move around. But, tanks explode in the normal arc.
-        else if (mode == ModeStatic2 || mode == ModeStatic3)
+        else if (scene.mode == ModeStatic2 || scene.mode == ModeStatic3)
         {
             bz_updateBZDBDouble("_tankSpeed", 0.000001);
             bz_updateBZDBDouble("_tankAngVel", 0.000001);
         }
 
         // If this is static1 or static2, set some other stuff.
-        if (mode == ModeStatic1 || mode == ModeStatic2) {
+        if (scene.mode == ModeStatic1 || scene.mode == ModeStatic2) {
             // Set some values that affect tanks and shots
-            bz_updateBZDBDouble("_shotSpeed", shotSpeed);
+            bz_updateBZDBDouble("_shotSpeed", scene.shotSpeed);
             bz_updateBZDBDouble("_shotRange", 0.05);
             bz_updateBZDBDouble("_laserAdLife", 1.0);
             bz_updateBZDBDouble("_thiefAdLife", 1.0);
@@ -188,17 +403,36 @@ void stagedSceneGenerator::Init ( const char* commandLine )
             bz_updateBZDBDouble("_reloadTime", 3.5);
         }
 
-        // Gotta go fast! (only useful when there are no players and only shots)
-        if (stagedPlayers.size() == 0)
-            MaxWaitTime = 0.05f;
+        // Cache the values the tick needs now that the modes are done changing them
+        reloadTime = bz_getBZDBDouble("_reloadTime");
+        explodeTime = bz_getBZDBDouble("_explodeTime");
+
+        // Now that the shot speeds are known, move any aged shots along their path
+        advanceShots();
+
+        // Queue up the first volley and let the scheduler decide how long bzfs can sleep
+        scheduleStatsDump(bz_getCurrentTime());
+        rebuildSchedule(bz_getCurrentTime());
 
         // Register a custom command
         bz_registerCustomSlashCommand("scene", this);
+
+        // Only start recording once the plugin is set up, since a replay sets it up again on its own
+        if (!scene.recordFile.empty() && SceneRecorder::enabled)
+        {
+            if (recorder.open(scene.recordFile, commandLine, startTime, serverValues))
+                bz_debugMessagef(1, "INFO: Recording the run to %s", scene.recordFile.c_str());
+            else
+                bz_debugMessagef(0, "WARNING: Unable to write the recording %s", scene.recordFile.c_str());
+        }
     }
 }
 
 void stagedSceneGenerator::Cleanup()
 {
+    log.flush();
+    recorder.close();
+
     // Remove custom command
     bz_removeCustomSlashCommand("scene");
 
@@ -206,398 +440,1509 @@ void stagedSceneGenerator::Cleanup()
     Flush();
 }
 
-bool stagedSceneGenerator::readConfig(const char* configFile)
+void stagedSceneGenerator::prepareScene(StagedScene &staged)
 {
-    // Parse the configuration
-    config.read(configFile);
+    if (!staged.needsRicochets() && staged.validation == ValidateOff)
+        return;
 
-    // If we had any errors, bail out
-    if (config.errors > 0)
-        return false;
+    auto started = std::chrono::steady_clock::now();
 
-    // Loop through each section of the configuration. There will be one section per tank or shot.
-    for (auto section : config.getSections())
+    // The world doesn't change while the server is running, so it only has to be read in once
+    if (!worldBuilt)
     {
-        // The main section will contain global settings that affect the plugin.
-        if (section == "main")
+        bz_APIWorldObjectList *objects = bz_getWorldObjectList();
+        for (unsigned int i = 0; i < objects->size(); ++i)
         {
-            for (auto item : config.getSectionItems(section))
+            bz_APIBaseWorldObject *object = objects->get(i);
+            if (object == NULL || object->type != eSolidObject)
+                continue;
+
+            // The API only gives us the box around each obstacle, so rotated boxes, pyramids and meshes are only
+            // approximated. Compiling the scene against the .bzw file traces them exactly.
+            bz_APISolidWorldObject_V1 *solid = (bz_APISolidWorldObject_V1*)object;
+            float center[3], halfSize[3];
+            for (int k = 0; k < 3; ++k)
             {
-                std::string name = makelower(item.first.c_str());
-                if (name == "shotdelay") {
-                    delayBetweenShots = atof(item.second.c_str());
-                    if (delayBetweenShots < 0.0 || delayBetweenShots > 60.0) {
-                        bz_debugMessage(0,"ERROR: ShotDelay must be between 0.0 and 60.0 (inclusive)");
-                        return false;
-                    }
-                }
-                else if (name == "shotspeed") {
-                    shotSpeed = atof(item.second.c_str());
-                    if (shotSpeed < 0.01 && shotSpeed > 1000.0) {
-                        bz_debugMessage(0,"ERROR: ShotSpeed must be between 0.01 and 1000.0 (inclusive)");
-                        return false;
-                    }
-                }
-                else if (name == "spawndelay") {
-                    spawnDelay = atof(item.second.c_str());
-                    if (spawnDelay < 0.0 || spawnDelay > 60.0) {
-                        bz_debugMessage(0,"ERROR: SpawnDelay must be between 0.0 and 60.0 (inclusive)");
-                        return false;
-                    }
-                }
-                else if (name == "mode")
-                {
-                    std::string _mode = makelower(item.second.c_str());
-                    if (_mode == "static1")
-                        mode = ModeStatic1;
-                    else if (_mode == "static2")
-                        mode = ModeStatic2;
-                    else if (_mode == "static3")
-                        mode = ModeStatic3;
-                    else if (_mode == "normal")
-                        mode = ModeNormal;
-                    else {
-                        bz_debugMessage(0,"ERROR: Mode must be one of: static1, static2, static3, or normal");
-                        return false;
-                    }
-                }
+                center[k] = (solid->minAABBox[k] + solid->maxAABBox[k]) / 2.0f;
+                halfSize[k] = (solid->maxAABBox[k] - solid->minAABBox[k]) / 2.0f;
             }
-            continue;
+            world.addBox(center, halfSize, 0.0f);
         }
+        bz_releaseWorldObjectList(objects);
 
-        // Store a lowercase copy of the type for comparisons
-        std::string type = makelower(config.item(section, "type").c_str());
+        world.setWorldSize((float)bz_getBZDBDouble("_worldSize"));
+        world.build();
+        worldBuilt = true;
+    }
 
-        // Congratulations Mr. and Mrs. Abrams, it's a tank
-        if (type == "tank")
-        {
-            StagedPlayer p;
+    if (staged.needsRicochets())
+    {
+        int solved = staged.solveRicochets(world);
 
-            p.sectionName = makelower(section.c_str());
-            p.team = teamFromString(config.item(section, "team"));
-            p.flag = makeupper(config.item(section, "flag").c_str());
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        bz_debugMessagef(1, "INFO: Traced %d ricocheting shots against %u obstacles in %.2f ms", solved,
+                         (unsigned)world.obstacleCount(), elapsed);
+    }
 
-            // A tank can be randomly spawned or set to spawn at a fixed location
-            p.random = (makelower(config.item(section, "random").c_str()) == "true");
+    staged.validate(&world, serverShotSpeeds());
+}
 
-            // If it's not random, read the position and rotation, if set
-            if (!p.random)
-            {
-                std::string pos = config.item(section, "pos");
-                if (pos.size() > 0)
-                {
-                    std::vector<std::string> pos2 = tokenize(pos, std::string(" "), 3, false);
-                    if (pos2.size() == 3)
-                    {
-                        p.pos[0] = atof(pos2.at(0).c_str());
-                        p.pos[1] = atof(pos2.at(1).c_str());
-                        p.pos[2] = atof(pos2.at(2).c_str());
-                    }
-                }
+void stagedSceneGenerator::advanceShots()
+{
+    const ServerShotSpeeds speeds = serverShotSpeeds();
 
-                std::string rot = config.item(section, "rot");
-                if (rot.size() > 0)
-                    p.rot = atof(rot.c_str());
-            }
+    for (size_t i = 0; i < scene.stagedShots.size(); ++i)
+    {
+        const StagedShot &stagedShot = scene.stagedShots[i];
+        if (stagedShot.age == 0.0f && stagedShot.distance == 0.0f)
+            continue;
 
-            // Add this staged player to our list
-            stagedPlayers.push_back(p);
-        }
-        // Guess I'll take a shot at this
-        else if (type == "shot")
+        // Lasers and thief are drawn as a whole beam from where they're fired, so there's nothing to advance
+        if (stagedShot.speedClass != ShotSpeedNormal)
         {
-            StagedShot s;
+            bz_debugMessagef(1, "WARNING: Ignoring the age or distance of a %s shot", stagedShot.flag.c_str());
+            continue;
+        }
 
-            s.team = teamFromString(config.item(section, "team"));
+        // The direction is a unit vector, so this is where the shot would be by now
+        const float distance = scene.startDistance(stagedShot, speeds);
+        for (int k = 0; k < 3; ++k)
+            scene.shotTable.pos[i * 3 + k] = stagedShot.pos[k] + stagedShot.dir[k] * distance;
+    }
+}
 
-            // A flag abbreviation can be provided to change the shot type
-            s.flag = makeupper(config.item(section, "flag").c_str());
+ServerShotSpeeds stagedSceneGenerator::serverShotSpeeds() const
+{
+    ServerShotSpeeds speeds;
+    speeds.shotSpeed = baseShotSpeed;
+    speeds.rapidFireAdVel = bz_getBZDBDouble("_rFireAdVel");
+    speeds.machineGunAdVel = bz_getBZDBDouble("_mGunAdVel");
+    return speeds;
+}
 
-            // If it's a GM, we can also have a target
-            if (s.flag == "GM") {
-                s.targetPlayerSectionName = makelower(config.item(section, "target").c_str());
-            }
+void stagedSceneGenerator::buildPlayerIndex()
+{
+    // The GM targets were resolved when the scene was loaded, so just invert them for joins and parts
+    shotsTargetingSlot.assign(scene.stagedPlayers.size(), std::vector<size_t>());
+    for (size_t i = 0; i < scene.shotTable.size(); ++i)
+    {
+        if (scene.shotTable.target[i] >= 0)
+            shotsTargetingSlot[scene.shotTable.target[i]].push_back(i);
+    }
 
-            std::string pos = config.item(section, "pos");
-            if (pos.size() > 0)
-            {
-                std::vector<std::string> pos2 = tokenize(pos, std::string(" "), 3, false);
-                if (pos2.size() == 3)
-                {
-                    s.pos[0] = atof(pos2.at(0).c_str());
-                    s.pos[1] = atof(pos2.at(1).c_str());
-                    s.pos[2] = atof(pos2.at(2).c_str());
-                }
-            }
+    // Staged players that already have a player (after a reload) keep them, and the rest start out available
+    freeSlots = decltype(freeSlots)();
+    std::fill(slotByPlayerID.begin(), slotByPlayerID.end(), -1);
+    for (size_t i = 0; i < scene.stagedPlayers.size(); ++i)
+    {
+        if (scene.stagedPlayers[i].playerID >= 0)
+            assignSlot(i, scene.stagedPlayers[i].playerID);
+        else
+            freeSlots.push(i);
+    }
+}
+
+bool stagedSceneGenerator::loadScene(int playerID, const std::string &fileName)
+{
+    // Playlists pass BZ_NULLUSER so stepping through the scenes only goes to the server log
+    reloadStarted = std::chrono::steady_clock::now();
+    reloadRequestedBy = playerID;
 
-            std::string strRot = config.item(section, "rot");
-            std::string strElev = config.item(section, "elev");
-            double rot = 0, elev = 0;
-            if (strRot.size() > 0)
-                rot = atof(strRot.c_str()) * M_PI / 180.0;
+    StagedScene next;
+    if (!next.load(fileName.c_str()))
+    {
+        if (playerID != BZ_NULLUSER)
+            bz_sendTextMessagef(BZ_SERVER, playerID, "Unable to load the scene from %s, see the server log", fileName.c_str());
+        return false;
+    }
 
-            if (strElev.size() > 0)
-                elev = (atof(strElev.c_str()) * M_PI / 180.0);
-            elev += M_PI / 2;
+    if (!playlist.empty())
+        usePlaylistFiles(next);
 
-            s.dir[0] = sin(elev) * cos(rot);
-            s.dir[1] = sin(elev) * sin(rot);
-            s.dir[2] = -cos(elev);
+    sceneFile = fileName;
+    prepareScene(next);
+    applyScene(next);
 
-            // Add this staged shot to our list
-            stagedShots.push_back(s);
-        }
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reloadStarted).count();
+    bz_debugMessagef(1, "INFO: Loaded %s in %.2f ms", fileName.c_str(), elapsed);
+    if (playerID == BZ_NULLUSER)
+        return true;
 
-    }
+    if (reloadRespawnsPending > 0)
+        bz_sendTextMessagef(BZ_SERVER, playerID, "Loaded %s in %.2f ms, waiting for %u tanks to respawn", fileName.c_str(), elapsed, (unsigned)reloadRespawnsPending);
+    else
+        bz_sendTextMessagef(BZ_SERVER, playerID, "Scene updated from %s in %.2f ms", fileName.c_str(), elapsed);
 
     return true;
 }
 
-bz_eTeamType stagedSceneGenerator::teamFromString(std::string team)
+void stagedSceneGenerator::applyScene(StagedScene &next)
 {
-    team = makelower(team.c_str());
-    if (team == "red") return eRedTeam;
-    else if (team == "green") return eGreenTeam;
-    else if (team == "blue") return eBlueTeam;
-    else if (team == "purple") return ePurpleTeam;
-    else if (team == "hunter") return eHunterTeam;
-    else if (team == "rabbit") return eRabbitTeam;
+    // The mode changed a bunch of server variables in Init, so it stays the same for the life of the server
+    if (next.mode != scene.mode)
+    {
+        bz_debugMessage(0, "WARNING: The mode can't be changed without restarting the server, so it is staying the same");
+        next.mode = scene.mode;
+    }
 
-    return eRogueTeam;
-}
+    if ((scene.mode == ModeStatic1 || scene.mode == ModeStatic2) && next.shotSpeed != scene.shotSpeed)
+        setShotSpeed(next.shotSpeed);
 
-void stagedSceneGenerator::Event(bz_EventData *eventData)
-{
-    switch(eventData->eventType)
+    // Groups that were turned on or off by hand stay that way
+    for (auto &group : next.groups)
     {
-    case bz_eGetAutoTeamEvent:
+        int before = scene.findGroup(group.name);
+        if (before >= 0)
+            group.enabled = scene.groups[before].enabled;
+    }
+
+    // Tanks keep their bot when their section is still there on the same team, and only respawn if they changed
+    std::map<std::string, size_t> slotBySection;
+    for (size_t i = 0; i < scene.stagedPlayers.size(); ++i)
+        slotBySection[scene.stagedPlayers[i].sectionName] = i;
+
+    std::vector<bool> kept(scene.stagedPlayers.size(), false);
+    for (auto &after : next.stagedPlayers)
     {
-        bz_GetAutoTeamEventData_V1* data = (bz_GetAutoTeamEventData_V1*)eventData;
-        // Ignore clients joining as observer
-        if (data->team != eObservers)
-        {
-            bz_debugMessagef(0, "INFO: Requested team for %d is %d", data->playerID, data->team);
-            // Find the first staged player that does not have an associated player
-            for (auto &stagedPlayer : stagedPlayers)
-            {
-                // We found an available staged player
-                if (stagedPlayer.playerID == -1)
-                {
-                    bz_debugMessagef(0, "INFO: Found available staged player for %d", data->playerID);
-                    stagedPlayer.playerID = data->playerID;
-                    data->team = stagedPlayer.team;
-                    data->handled = true;
+        auto found = slotBySection.find(after.sectionName);
+        if (found == slotBySection.end())
+            continue;
 
-                    for (auto &stagedShot : stagedShots) {
-                        if (stagedShot.targetPlayerSectionName == stagedPlayer.sectionName)
-                            stagedShot.targetPlayerID = stagedPlayer.playerID;
-                    }
+        const StagedPlayer &before = scene.stagedPlayers[found->second];
+        if (before.playerID < 0 || before.team != after.team)
+            continue;
 
-                    break;
-                }
-            }
+        kept[found->second] = true;
+        after.playerID = before.playerID;
+        after.lastDeath = before.lastDeath;
+        after.respawnPending = before.respawnPending;
+        after.alive = before.alive;
+        after.deaths = before.deaths;
+        after.driftKills = before.driftKills;
+        after.maxDrift = before.maxDrift;
+        after.diedAt = before.diedAt;
+        after.timeLost = before.timeLost;
+        after.reloadRespawn = before.reloadRespawn || before.random != after.random || before.rot != after.rot
+                              || before.flag != after.flag || !std::equal(before.pos, before.pos + 3, after.pos);
+    }
 
-            // If all the staged players are ... staged ... then just make this player an observer.
-            // This has the positive side effect of also making extra -solo bots go away.
-            if (!data->handled)
-            {
-                bz_debugMessagef(0, "WARNING: No available staged player for %d, so assigning observer", data->playerID);
-                data->team = eObservers;
-                data->handled = true;
-            }
-        }
-        break;
+    // Every other bot gets the first free staged player on its team, or gets parked if there isn't one
+    std::vector<int> spareBots;
+    spareBots.swap(parkedBots);
+    for (size_t i = 0; i < scene.stagedPlayers.size(); ++i)
+    {
+        if (scene.stagedPlayers[i].playerID >= 0 && !kept[i])
+            spareBots.push_back(scene.stagedPlayers[i].playerID);
     }
 
-    case bz_eGetPlayerSpawnPosEvent:
+    for (int playerID : spareBots)
     {
-        bz_GetPlayerSpawnPosEventData_V1* data = (bz_GetPlayerSpawnPosEventData_V1*)eventData;
+        bz_eTeamType team = bz_getPlayerTeam(playerID);
+        auto free = std::find_if(next.stagedPlayers.begin(), next.stagedPlayers.end(), [team](const StagedPlayer &p) {
+            return p.playerID < 0 && p.team == team;
+        });
 
-        // See if this is a staged player
-        for (auto stagedPlayer : stagedPlayers)
+        if (free != next.stagedPlayers.end())
         {
-            // We found a match!
-            if (stagedPlayer.playerID == data->playerID)
-            {
-                bz_debugMessagef(0, "INFO: Spawning staged player %d", data->playerID);
+            free->playerID = playerID;
+            free->reloadRespawn = true;
+        }
+        else
+            parkedBots.push_back(playerID);
+    }
 
-                // If this isn't a random spawn, set the position and rotation
-                if (!stagedPlayer.random)
-                {
-                    data->pos[0] = stagedPlayer.pos[0];
-                    data->pos[1] = stagedPlayer.pos[1];
-                    data->pos[2] = stagedPlayer.pos[2];
-                    data->rot = stagedPlayer.rot * M_PI / 180.0f;
-                }
+    scene = std::move(next);
+    reportShotSpeedWrites();
 
-                // Spawn the tank slightly in the air. For mode static1, this ensures that it won't be moving around.
-                // For other modes, it helps ensure that tanks aren't getting stuck in objects.
-                data->pos[2] += 0.01;
+    buildPlayerIndex();
+    advanceShots();
 
-                data->handled = true;
+    // Fire the new shots right away
+    resetShotPool();
+    scheduleStatsDump(bz_getCurrentTime());
+    rebuildSchedule(bz_getCurrentTime());
 
-                // Break out of the 'for' loop
-                break;
-            }
-        }
-        break;
+    // Move the tanks that changed by killing them, which respawns them right away at their new spot
+    reloadRespawnsPending = 0;
+    for (auto &stagedPlayer : scene.stagedPlayers)
+    {
+        // Tanks in groups that are turned off stay dead until the group is turned on
+        if (!scene.groups[stagedPlayer.group].enabled)
+            stagedPlayer.reloadRespawn = false;
+        if (!stagedPlayer.reloadRespawn)
+            continue;
+
+        // Bots that moved from another tank may still be waiting out that tank's spawn delay
+        ++reloadRespawnsPending;
+        stagedPlayer.respawnPending = false;
+        bz_setPlayerSpawnable(stagedPlayer.playerID, true);
+        bz_killPlayer(stagedPlayer.playerID, false);
     }
 
-    case bz_ePlayerSpawnEvent:
+    for (int playerID : parkedBots)
     {
-        if (spawnDelay == 0.0)
-            break;
+        bz_setPlayerSpawnable(playerID, false);
+        bz_killPlayer(playerID, false);
+    }
 
-        bz_PlayerSpawnEventData_V1* data = (bz_PlayerSpawnEventData_V1*)eventData;
+    for (size_t i = 0; i < scene.stagedPlayers.size(); ++i)
+    {
+        if (!scene.groups[scene.stagedPlayers[i].group].enabled)
+            holdTank(i);
+    }
+
+    updateReadiness(bz_getCurrentTime());
+}
+
+void stagedSceneGenerator::reportShotSpeedWrites() const
+{
+    int saved = scene.shotSpeedWritesSaved();
+    if (saved > 0)
+        bz_debugMessagef(1, "INFO: Grouping the shots by speed saves %d BZDB updates each time every group fires", saved);
+}
+
+bool stagedSceneGenerator::readPlaylist(const std::string &fileName)
+{
+    std::ifstream file(fileName.c_str());
+    if (!file)
+    {
+        bz_debugMessagef(0, "ERROR: Unable to open the playlist %s", fileName.c_str());
+        return false;
+    }
+
+    // Scene files that aren't absolute paths are relative to the playlist
+    std::string directory;
+    size_t slash = fileName.find_last_of('/');
+    if (slash != std::string::npos)
+        directory = fileName.substr(0, slash + 1);
 
-        for (auto &stagedPlayer : stagedPlayers)
+    std::vector<PlaylistEntry> entries;
+    std::string readyFile, statsFile;
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); ++lineNumber)
+    {
+        // Each line has the number of seconds to hold a scene followed by the scene file
+        std::istringstream fields(line);
+        PlaylistEntry entry;
+        if (!(fields >> entry.duration))
         {
-            if (stagedPlayer.playerID == data->playerID && !stagedPlayer.flag.empty())
+            std::string first;
+            std::istringstream blank(line);
+            if (!(blank >> first) || first[0] == '#')
+                continue;
+
+            // Or sets the ReadyFile or StatsFile for all of the scenes
+            size_t equals = line.find('=');
+            std::string key = equals != std::string::npos ? makelower(trimmed(line.substr(0, equals)).c_str()) : "";
+            std::string value = equals != std::string::npos ? trimmed(line.substr(equals + 1)) : "";
+            if ((key == "readyfile" || key == "statsfile") && !value.empty())
             {
-                bz_debugMessagef(0, "INFO: Giving staged player %d the %s flag", data->playerID, stagedPlayer.flag.c_str());
+                if (value[0] != '/')
+                    value = directory + value;
+                (key == "readyfile" ? readyFile : statsFile) = value;
+                continue;
+            }
 
-                bz_givePlayerFlag(data->playerID, stagedPlayer.flag.c_str(), false);
+            bz_debugMessagef(0, "ERROR: Line %d of the playlist %s doesn't start with a duration, ReadyFile or StatsFile", lineNumber, fileName.c_str());
+            return false;
+        }
 
-                break;
-            }
+        std::getline(fields >> std::ws, entry.fileName);
+        while (!entry.fileName.empty() && isspace((unsigned char)entry.fileName.back()))
+            entry.fileName.pop_back();
+
+        if (entry.duration <= 0.0 || entry.fileName.empty())
+        {
+            bz_debugMessagef(0, "ERROR: Line %d of the playlist %s needs a positive duration and a scene file", lineNumber, fileName.c_str());
+            return false;
         }
 
-        break;
+        if (entry.fileName[0] != '/')
+            entry.fileName = directory + entry.fileName;
+
+        entries.push_back(entry);
     }
 
-    case bz_ePlayerDieEvent:
+    if (entries.empty())
     {
-        bz_PlayerDieEventData_V2* data = (bz_PlayerDieEventData_V2*)eventData;
+        bz_debugMessagef(0, "ERROR: The playlist %s has no scenes", fileName.c_str());
+        return false;
+    }
 
-        for (auto &stagedPlayer: stagedPlayers)
+    playlist.swap(entries);
+    playlistReadyFile = readyFile;
+    playlistStatsFile = statsFile;
+    return true;
+}
+
+bool stagedSceneGenerator::loadStartupPlaylist()
+{
+    // The bots haven't joined yet, so the first scene that loads is held until it's ready and the rest follow from
+    // there. Init does the rest of the setup for it like any other scene.
+    playlistRequestedBy = BZ_NULLUSER;
+    playlistPosition = 0;
+    while (playlistPosition < playlist.size())
+    {
+        const PlaylistEntry &entry = playlist[playlistPosition++];
+        StagedScene first;
+        if (!first.load(entry.fileName.c_str()))
         {
-            if (stagedPlayer.playerID == data->playerID) {
-                // Disable spawning so we can add a delay between the explosion ending and the respawn
-                bz_setPlayerSpawnable(data->playerID, false);
-                stagedPlayer.lastDeath = data->eventTime;
-                break;
-            }
+            bz_debugMessagef(0, "WARNING: Skipping %s in the playlist", entry.fileName.c_str());
+            continue;
         }
-    }
 
-    case bz_ePlayerUpdateEvent:
-    {
-        // We don't need to bother with this in normal mode
-        if (mode == ModeNormal)
-            break;
+        usePlaylistFiles(first);
+        scene = std::move(first);
+        sceneFile = entry.fileName;
+        scenesShown = 1;
+        playlistWaiting = true;
+        bz_debugMessagef(1, "INFO: Holding %s until it's ready to start the playlist", sceneFile.c_str());
+        return true;
+    }
 
-        bz_PlayerUpdateEventData_V1* data = (bz_PlayerUpdateEventData_V1*)eventData;
+    bz_debugMessage(0, "ERROR: None of the scenes in the playlist could be loaded");
+    return false;
+}
 
-        // Only the living is allowed past this point.
-        if (data->state.status != eAlive)
-            break;
+void stagedSceneGenerator::usePlaylistFiles(StagedScene &next) const
+{
+    if (!playlistReadyFile.empty())
+        next.readyFile = playlistReadyFile;
+    if (!playlistStatsFile.empty())
+        next.statsFile = playlistStatsFile;
+}
 
-        if (mode == ModeStatic1) {
-            // We spawn tanks in the air, and have gravity set real low. Eventually a tank might land and start
-            // moving, so kill 'em if they do.
-            if (data->state.velocity[0] != 0.0f || data->state.velocity[1] != 0.0f)
-            {
-                bz_debugMessagef(0, "NOTE: Killing player '%s' because they moved", bz_getPlayerCallsign(data->playerID));
-                bz_killPlayer(data->playerID, false);
-            }
-        }
-        else if (mode == ModeStatic2) {
-            // Find the staged player record
-            for (auto &stagedPlayer : stagedPlayers)
-            {
-                if (stagedPlayer.playerID == data->playerID) {
-                    // If they have moved a bit from their staged position, kill 'em
-                    if (fabs(stagedPlayer.pos[0] - data->state.pos[0]) > 0.1 || fabs(stagedPlayer.pos[1] - data->state.pos[1]) > 0.1) {
-                        bz_debugMessagef(0, "NOTE: Killing player '%s' because they moved", bz_getPlayerCallsign(data->playerID));
-                        bz_killPlayer(data->playerID, false);
-                    }
-                    break;
-                }
-            }
-        }
-        break;
-    }
+void stagedSceneGenerator::startPlaylist(int playerID, double now)
+{
+    playlistRequestedBy = playerID;
+    playlistPosition = 0;
+    playlistStarted = now;
+    playlistWaiting = false;
+    scenesShown = 0;
+
+    bz_sendTextMessagef(BZ_SERVER, playerID, "Starting a playlist of %u scenes", (unsigned)playlist.size());
+    nextPlaylistScene(now);
+}
 
-    case bz_ePlayerPartEvent:
+void stagedSceneGenerator::nextPlaylistScene(double now)
+{
+    // Scenes that fail to load are skipped so one bad file doesn't hold up the whole batch
+    while (playlistPosition < playlist.size())
     {
-        bz_PlayerJoinPartEventData_V1* data = (bz_PlayerJoinPartEventData_V1*)eventData;
-
-        // When a player leaves, see if they were assigned to a staged player and release them
-        for (auto &stagedPlayer : stagedPlayers)
+        const PlaylistEntry &entry = playlist[playlistPosition++];
+        if (!loadScene(BZ_NULLUSER, entry.fileName))
         {
-            if (stagedPlayer.playerID == data->playerID) {
-                stagedPlayer.playerID = -1;
-
-                for (auto &stagedShot : stagedShots) {
-                    if (stagedShot.targetPlayerSectionName == stagedPlayer.sectionName)
-                        stagedShot.targetPlayerID = -1;
-                }
-            }
+            bz_debugMessagef(0, "WARNING: Skipping %s in the playlist", entry.fileName.c_str());
+            continue;
         }
 
-        break;
+        ++scenesShown;
+        nextSceneAt = now + entry.duration;
+        rebuildSchedule(now);
+        return;
     }
 
-    case bz_eTickEvent:
-    {
-        bz_TickEventData_V1* data = (bz_TickEventData_V1*)eventData;
+    // The farm and capture scripts wait for this line, so the stats are written first
+    reportPlaylist(playlistRequestedBy, now);
+    if (!scene.statsFile.empty())
+        dumpStats(now);
+    bz_debugMessage(1, "INFO: Playlist finished");
+    stopPlaylist(now);
+}
 
-        // I'ma firing my BLAAAAARRRR
-        if (data->eventTime > lastShotsFired + bz_getBZDBDouble("_reloadTime") + delayBetweenShots)
-        {
-            lastShotsFired = data->eventTime;
-            for (auto stagedShot : stagedShots)
-            {
-                if (mode == ModeStatic1 || mode == ModeStatic2) {
-                    // The laser and thief length is based on shot speed, so change the shot speed for this shot
-                    if (stagedShot.flag == "L")
-                        bz_updateBZDBDouble("_shotSpeed", laserShotSpeed);
-                    else if (stagedShot.flag == "TH")
-                        bz_updateBZDBDouble("_shotSpeed", thiefShotSpeed);
-                }
+void stagedSceneGenerator::stopPlaylist(double now)
+{
+    playlist.clear();
+    playlistWaiting = false;
+    nextSceneAt = -1.0;
+    rebuildSchedule(now);
+}
+
+void stagedSceneGenerator::reportPlaylist(int playerID, double now)
+{
+    double elapsed = now - playlistStarted;
+    double perHour = elapsed > 0.0 ? scenesShown * 3600.0 / elapsed : 0.0;
+
+    bz_debugMessagef(1, "INFO: Playlist showed %u of %u scenes in %.1f seconds (%.0f scenes per hour)",
+                     (unsigned)scenesShown, (unsigned)playlist.size(), elapsed, perHour);
+    if (playerID != BZ_NULLUSER)
+        bz_sendTextMessagef(BZ_SERVER, playerID, "Playlist showed %u of %u scenes in %.1f seconds (%.0f scenes per hour)",
+                        (unsigned)scenesShown, (unsigned)playlist.size(), elapsed, perHour);
+}
 
-                // FIRE!!!
-                bz_fireServerShot(stagedShot.flag.c_str(), stagedShot.pos, stagedShot.dir, stagedShot.team, stagedShot.targetPlayerID);
-                bz_debugMessagef(1, "Firing shot at %f %f %f", stagedShot.pos[0], stagedShot.pos[1], stagedShot.pos[2]);
+void stagedSceneGenerator::scheduleStatsDump(double now)
+{
+    // Keep the running schedule across reloads so short playlist scenes don't keep pushing the dump back
+    if (scene.statsFile.empty())
+        nextStatsDump = -1.0;
+    else if (nextStatsDump < 0.0)
+        nextStatsDump = now + scene.statsInterval;
+}
 
-                if (mode == ModeStatic1 || mode == ModeStatic2) {
-                    // If we just shot a laser or thief, remember to set the shot speed again
-                    if (stagedShot.flag == "L" || stagedShot.flag == "TH")
-                        bz_updateBZDBDouble("_shotSpeed", shotSpeed);
-                }
-            }
-        }
+void stagedSceneGenerator::dumpStats(double now)
+{
+    if (!stats.dump(scene.statsFile, now))
+        bz_debugMessagef(0, "WARNING: Unable to write the stats to %s", scene.statsFile.c_str());
+}
 
-        if (spawnDelay > 0.0)
-        {
-            double explodeTime = bz_getBZDBDouble("_explodeTime");
+bool stagedSceneGenerator::isSceneReady(double now) const
+{
+    // Only the groups that are turned on have to be there
+    for (auto &stagedPlayer : scene.stagedPlayers)
+    {
+        if (scene.groups[stagedPlayer.group].enabled && (stagedPlayer.playerID < 0 || !stagedPlayer.alive))
+            return false;
+    }
 
-            for (auto &stagedPlayer : stagedPlayers)
-            {
-                if (data->eventTime > stagedPlayer.lastDeath + explodeTime + spawnDelay)
-                    bz_setPlayerSpawnable(stagedPlayer.playerID, true);
-            }
-        }
+    return enabledShots == 0 || populatedUntil > now;
+}
+
+void stagedSceneGenerator::updateReadiness(double now)
+{
+    bool ready = isSceneReady(now);
+    if (ready == sceneReady)
+        return;
+
+    sceneReady = ready;
+    if (!ready)
+    {
+        log.messagef(2, "DEBUG: Scene generation %u is no longer ready", readyGeneration);
+        return;
     }
 
-    default:
-        break;
+    ++readyGeneration;
+    log.messagef(1, "INFO: Scene ready (generation %u)", readyGeneration);
+    bz_sendTextMessagef(BZ_SERVER, BZ_ALLUSERS, "Scene ready (generation %u)", readyGeneration);
+    signalReadyFile();
+
+    // The first scene of a playlist from the command line is only timed from here
+    if (playlistWaiting)
+    {
+        playlistWaiting = false;
+        playlistStarted = now;
+        nextSceneAt = now + playlist[playlistPosition - 1].duration;
+        log.messagef(1, "INFO: Starting a playlist of %u scenes", (unsigned)playlist.size());
+        rebuildSchedule(now);
     }
 }
 
-bool stagedSceneGenerator::SlashCommand ( int playerID, bz_ApiString /*cmd*/, bz_ApiString, bz_APIStringList* cmdParams )
+void stagedSceneGenerator::signalReadyFile()
 {
-    std::string subcommand = makelower(cmdParams->get(0).c_str());
+    if (scene.readyFile.empty())
+        return;
 
-    if (subcommand == "reset") {
-        for (auto &stagedPlayer : stagedPlayers)
-        {
-            if (stagedPlayer.playerID > -1)
-                bz_killPlayer(stagedPlayer.playerID, false);
+    char line[64];
+    int length = snprintf(line, sizeof(line), "%u\n", readyGeneration);
+
+#ifdef _WIN32
+    FILE *file = fopen(scene.readyFile.c_str(), "w");
+    if (file == NULL)
+    {
+        bz_debugMessagef(0, "WARNING: Unable to write to the ready file %s", scene.readyFile.c_str());
+        return;
+    }
+    fwrite(line, 1, length, file);
+    fclose(file);
+#else
+    // Don't block the server if nothing is reading the FIFO yet, the capture script can use /scene status instead
+    int fd = open(scene.readyFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK, 0644);
+    if (fd < 0)
+    {
+        if (errno != ENXIO)
+            bz_debugMessagef(0, "WARNING: Unable to write to the ready file %s", scene.readyFile.c_str());
+        return;
+    }
+    if (write(fd, line, length) != length)
+        bz_debugMessagef(0, "WARNING: Unable to write to the ready file %s", scene.readyFile.c_str());
+    close(fd);
+#endif
+}
+
+void stagedSceneGenerator::adoptParkedBot(size_t slot)
+{
+    StagedPlayer &stagedPlayer = scene.stagedPlayers[slot];
+    for (auto parked = parkedBots.begin(); parked != parkedBots.end(); ++parked)
+    {
+        if (bz_getPlayerTeam(*parked) != stagedPlayer.team)
+            continue;
+
+        // The slot was just put back in the free list, so take it out again
+        std::vector<size_t> stillFree;
+        while (!freeSlots.empty())
+        {
+            if (freeSlots.top() != slot)
+                stillFree.push_back(freeSlots.top());
+            freeSlots.pop();
+        }
+        for (size_t free : stillFree)
+            freeSlots.push(free);
+
+        assignSlot(slot, *parked);
+        bz_setPlayerSpawnable(*parked, true);
+        parkedBots.erase(parked);
+        return;
+    }
+}
+
+void stagedSceneGenerator::assignSlot(size_t slot, int playerID)
+{
+    StagedPlayer &stagedPlayer = scene.stagedPlayers[slot];
+    stagedPlayer.playerID = playerID;
+
+    if (playerID >= (int)slotByPlayerID.size())
+        slotByPlayerID.resize(playerID + 1, -1);
+    slotByPlayerID[playerID] = (int)slot;
+
+    for (size_t shot : shotsTargetingSlot[slot])
+        scene.shotTable.targetPlayerID[shot] = playerID;
+}
+
+void stagedSceneGenerator::releaseSlot(size_t slot)
+{
+    StagedPlayer &stagedPlayer = scene.stagedPlayers[slot];
+    slotByPlayerID[stagedPlayer.playerID] = -1;
+    stagedPlayer.playerID = -1;
+    stagedPlayer.respawnPending = false;
+    stagedPlayer.alive = false;
+
+    for (size_t shot : shotsTargetingSlot[slot])
+        scene.shotTable.targetPlayerID[shot] = -1;
+
+    freeSlots.push(slot);
+}
+
+void stagedSceneGenerator::setShotSpeed(double speed)
+{
+    stats.count(CounterBZDBWrites);
+    changingShotSpeed = true;
+    bz_updateBZDBDouble("_shotSpeed", speed);
+    changingShotSpeed = false;
+}
+
+void stagedSceneGenerator::refreshBZDBValue(const std::string &key, double value)
+{
+    if (key == "_reloadTime" || key == "_explodeTime")
+    {
+        if (key == "_reloadTime")
+            reloadTime = value;
+        else
+            explodeTime = value;
+
+        // Everything that was scheduled with the old value is now due at a different time
+        rebuildSchedule(bz_getCurrentTime());
+    }
+    else if (scene.mode == ModeStatic1 || scene.mode == ModeStatic2)
+    {
+        // The static modes pin the shot speed and laser/thief lifetimes, so a new _shotSpeed from an admin is the
+        // speed to restore after each laser or thief group
+        if (key == "_shotSpeed")
+            scene.shotSpeed = value;
+    }
+    else
+    {
+        if (key == "_shotSpeed")
+            baseShotSpeed = value;
+        else if (key == "_laserAdLife")
+            laserAdLife = value;
+        else if (key == "_thiefAdLife")
+            thiefAdLife = value;
+        else
+            return;
+
+        laserShotSpeed = baseShotSpeed * laserAdLife;
+        thiefShotSpeed = baseShotSpeed * thiefAdLife;
+    }
+}
+
+void stagedSceneGenerator::fireVolley(size_t group, double now)
+{
+    ScopedTimer timer(stats, TimerVolley);
+    GroupSchedule &schedule = groupSchedules[group];
+    stats.count(CounterShotsFired, schedule.shotCount);
+
+    const bool changeShotSpeed = (scene.mode == ModeStatic1 || scene.mode == ModeStatic2);
+    bool changedShotSpeed = false;
+
+    // The shots are sorted by speed class and then by group, so the shot speed only has to change when we reach the
+    // next speed class, and the group's shots in each class are all together
+    const uint16_t* groups = scene.shotTable.group.data();
+    schedule.populatedUntil = std::numeric_limits<double>::infinity();
+    for (int c = ShotSpeedNormal; c < ShotSpeedClassCount; ++c)
+    {
+        const size_t start = std::lower_bound(groups + scene.shotTable.classStart[c], groups + scene.shotTable.classStart[c + 1], group) - groups;
+        const size_t end = std::upper_bound(groups + start, groups + scene.shotTable.classStart[c + 1], group) - groups;
+        if (start == end)
+            continue;
+
+        if (changeShotSpeed && c != ShotSpeedNormal)
+        {
+            setShotSpeed(c == ShotSpeedLaser ? laserShotSpeed : thiefShotSpeed);
+            changedShotSpeed = true;
+        }
+
+        for (size_t i = start; i < end; ++i)
+        {
+            float* pos = &scene.shotTable.pos[i * 3];
+
+            // FIRE!!!
+            bz_fireServerShot(scene.shotFlags[scene.shotTable.flag[i]].c_str(), pos, &scene.shotTable.dir[i * 3], scene.shotTable.team[i], scene.shotTable.targetPlayerID[i]);
+            if (recorder.isOpen())
+                recorder.shot(now, scene.shotFlags[scene.shotTable.flag[i]].c_str(), pos, &scene.shotTable.dir[i * 3], scene.shotTable.team[i], scene.shotTable.targetPlayerID[i]);
+            if (log.wants(4))
+                log.messagef(4, "Firing shot at %f %f %f", pos[0], pos[1], pos[2]);
+        }
+
+        // The group is complete until its shortest lived class of shots expires
+        schedule.populatedUntil = std::min(schedule.populatedUntil, now + shotLifetime(c));
+    }
+
+    log.messagef(2, "DEBUG: Fired %u staged shots in group %s", (unsigned)schedule.shotCount, scene.groups[group].name.c_str());
+
+    // If we ended on a laser or thief group, remember to set the shot speed again
+    if (changedShotSpeed)
+        setShotSpeed(scene.shotSpeed);
+
+    updatePopulated();
+}
+
+void stagedSceneGenerator::updatePopulated()
+{
+    // With volleys, the scene is complete until the first group that is turned on runs out of shots
+    populatedUntil = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < groupSchedules.size(); ++i)
+    {
+        if (scene.groups[i].enabled && groupSchedules[i].shotCount > 0)
+            populatedUntil = std::min(populatedUntil, groupSchedules[i].populatedUntil);
+    }
+}
+
+void stagedSceneGenerator::refireShots(double now)
+{
+    // Hand the free slots to the shots that have been waiting the longest
+    dueShots.clear();
+    while (activeShots < scene.maxShots && !waitingShots.empty())
+    {
+        dueShots.push_back(waitingShots.front());
+        waitingShots.pop_front();
+        ++activeShots;
+    }
+
+    if (!dueShots.empty())
+    {
+        ScopedTimer timer(stats, TimerVolley);
+        stats.count(CounterShotsFired, dueShots.size());
+
+        const bool changeShotSpeed = (scene.mode == ModeStatic1 || scene.mode == ModeStatic2);
+        bool changedShotSpeed = false;
+
+        // The shot table is sorted by speed class, so firing in index order keeps each class together
+        std::sort(dueShots.begin(), dueShots.end());
+
+        int currentClass = ShotSpeedNormal;
+        for (uint32_t shot : dueShots)
+        {
+            int c = currentClass;
+            while (shot >= scene.shotTable.classStart[c + 1])
+                ++c;
+
+            if (c != currentClass)
+            {
+                currentClass = c;
+                if (changeShotSpeed)
+                {
+                    setShotSpeed(c == ShotSpeedLaser ? laserShotSpeed : thiefShotSpeed);
+                    changedShotSpeed = true;
+                }
+            }
+
+            float* pos = &scene.shotTable.pos[shot * 3];
+            bz_fireServerShot(scene.shotFlags[scene.shotTable.flag[shot]].c_str(), pos, &scene.shotTable.dir[shot * 3], scene.shotTable.team[shot], scene.shotTable.targetPlayerID[shot]);
+            if (recorder.isOpen())
+                recorder.shot(now, scene.shotFlags[scene.shotTable.flag[shot]].c_str(), pos, &scene.shotTable.dir[shot * 3], scene.shotTable.team[shot], scene.shotTable.targetPlayerID[shot]);
+            if (log.wants(4))
+                log.messagef(4, "Firing shot at %f %f %f", pos[0], pos[1], pos[2]);
+
+            // The slot frees up again once the shot is gone and its group's shot delay has passed
+            shotExpires[shot] = now + shotLifetime(c) + scene.groups[scene.shotTable.group[shot]].delayBetweenShots;
+            deadlines.push({shotExpires[shot], DeadlineShotExpiry, shot});
+        }
+
+        if (changedShotSpeed)
+            setShotSpeed(scene.shotSpeed);
+
+        log.messagef(2, "DEBUG: Refired %u staged shots", (unsigned)dueShots.size());
+    }
+
+    // Every slot we can use is taken, so the scene is complete until the next shot expires
+    if (activeShots - carriedShots >= std::min(scene.maxShots, enabledShots))
+        populatedUntil = std::numeric_limits<double>::infinity();
+    else
+        populatedUntil = now;
+}
+
+void stagedSceneGenerator::resetShotPool()
+{
+    // Shots in groups that are turned off don't get in line until the group is turned on
+    groupSchedules.assign(scene.groups.size(), GroupSchedule());
+    waitingShots.clear();
+    enabledShots = 0;
+    for (uint32_t i = 0; i < scene.shotTable.size(); ++i)
+    {
+        const uint16_t group = scene.shotTable.group[i];
+        ++groupSchedules[group].shotCount;
+        if (!scene.groups[group].enabled)
+            continue;
+
+        waitingShots.push_back(i);
+        ++enabledShots;
+    }
+
+    // The last scene's shots that are still in flight hold on to their slots
+    std::vector<double> carried;
+    for (double expires : carriedExpires)
+    {
+        if (expires >= 0.0)
+            carried.push_back(expires);
+    }
+    for (double expires : shotExpires)
+    {
+        if (expires >= 0.0)
+            carried.push_back(expires);
+    }
+    carriedExpires.swap(carried);
+    carriedShots = carriedExpires.size();
+
+    shotExpires.assign(scene.shotTable.size(), -1.0);
+    populatedUntil = 0.0;
+    dueShots.reserve(std::min(scene.maxShots, scene.shotTable.size()));
+    activeShots = carriedShots;
+
+    if (scene.refireMode == RefireContinuous && scene.shotTable.size() > scene.maxShots)
+        bz_debugMessagef(1, "INFO: %u staged shots will take turns in %u shot slots", (unsigned)scene.shotTable.size(), (unsigned)scene.maxShots);
+}
+
+double stagedSceneGenerator::shotLifetime(int speedClass) const
+{
+    // Server shots live for _reloadTime, with lasers and thief scaled by their lifetime multiplier. The static modes
+    // force those multipliers to 1.
+    if (scene.mode == ModeStatic1 || scene.mode == ModeStatic2 || speedClass == ShotSpeedNormal)
+        return reloadTime;
+    return reloadTime * (speedClass == ShotSpeedLaser ? laserAdLife : thiefAdLife);
+}
+
+void stagedSceneGenerator::trackCoverage(double now)
+{
+    if (enabledShots > 0 && coverageLastTime >= 0.0)
+    {
+        coverageObserved += now - coverageLastTime;
+        coveragePopulated += std::max(0.0, std::min(now, populatedUntil) - coverageLastTime);
+    }
+    coverageLastTime = now;
+}
+
+void stagedSceneGenerator::setGroupEnabled(size_t group, bool enabled, double now)
+{
+    if (scene.groups[group].enabled == enabled)
+        return;
+
+    scene.groups[group].enabled = enabled;
+    log.messagef(1, "INFO: Group %s turned %s", scene.groups[group].name.c_str(), enabled ? "on" : "off");
+
+    // The group's shots that aren't in flight get back in line for continuous refire, or leave it. Shots that are
+    // in flight are left alone and won't be fired again.
+    GroupSchedule &schedule = groupSchedules[group];
+    if (enabled)
+    {
+        enabledShots += schedule.shotCount;
+        for (uint32_t i = 0; i < scene.shotTable.size(); ++i)
+        {
+            if (scene.shotTable.group[i] == group && shotExpires[i] < 0.0)
+                waitingShots.push_back(i);
+        }
+    }
+    else
+    {
+        enabledShots -= schedule.shotCount;
+        waitingShots.erase(std::remove_if(waitingShots.begin(), waitingShots.end(), [this, group](uint32_t shot) {
+            return scene.shotTable.group[shot] == group;
+        }), waitingShots.end());
+    }
+
+    // A group that is turned back on fires its volley right away
+    if (enabled)
+    {
+        schedule.lastShotsFired = -9999.0;
+        schedule.populatedUntil = 0.0;
+        scheduleVolley(group);
+    }
+
+    if (scene.refireMode == RefireVolley)
+        updatePopulated();
+    else if (enabled && schedule.shotCount > 0)
+        populatedUntil = now;
+
+    // The group's tanks are kept dead while it is off, and spawn again as soon as it is on
+    for (size_t i = 0; i < scene.stagedPlayers.size(); ++i)
+    {
+        StagedPlayer &stagedPlayer = scene.stagedPlayers[i];
+        if (stagedPlayer.group != group || stagedPlayer.playerID < 0)
+            continue;
+
+        if (enabled)
+        {
+            stagedPlayer.respawnPending = false;
+            bz_setPlayerSpawnable(stagedPlayer.playerID, true);
+        }
+        else
+            holdTank(i);
+    }
+
+    updateReadiness(now);
+    updateWaitTime(now);
+}
+
+void stagedSceneGenerator::holdTank(size_t slot)
+{
+    StagedPlayer &stagedPlayer = scene.stagedPlayers[slot];
+    if (stagedPlayer.playerID < 0)
+        return;
+
+    stagedPlayer.respawnPending = false;
+    bz_setPlayerSpawnable(stagedPlayer.playerID, false);
+    bz_killPlayer(stagedPlayer.playerID, false);
+}
+
+void stagedSceneGenerator::reportGroups(int playerID, double now)
+{
+    bz_sendTextMessagef(BZ_SERVER, playerID, "%u scene groups:", (unsigned)scene.groups.size());
+
+    std::vector<unsigned int> tanks(scene.groups.size(), 0), alive(scene.groups.size(), 0);
+    for (auto &stagedPlayer : scene.stagedPlayers)
+    {
+        ++tanks[stagedPlayer.group];
+        if (stagedPlayer.playerID >= 0 && stagedPlayer.alive)
+            ++alive[stagedPlayer.group];
+    }
+
+    for (size_t i = 0; i < scene.groups.size(); ++i)
+    {
+        const StagedGroup &group = scene.groups[i];
+        const GroupSchedule &schedule = groupSchedules[i];
+        bz_sendTextMessagef(BZ_SERVER, playerID, "  %s: %s, %u of %u tanks alive, %u shots, shot delay %.1f, spawn delay %.1f",
+                            group.name.c_str(), group.enabled ? "on" : "off", alive[i], tanks[i], (unsigned)schedule.shotCount,
+                            group.delayBetweenShots, group.spawnDelay);
+        if (group.enabled && schedule.shotCount > 0 && scene.refireMode == RefireVolley)
+            bz_sendTextMessagef(BZ_SERVER, playerID, "    next volley in %.1f seconds", std::max(0.0, schedule.nextShotsFired - now));
+    }
+}
+
+void stagedSceneGenerator::scheduleVolley(size_t group)
+{
+    GroupSchedule &schedule = groupSchedules[group];
+    if (schedule.shotCount == 0 || scene.refireMode != RefireVolley || !scene.groups[group].enabled)
+        return;
+
+    schedule.nextShotsFired = schedule.lastShotsFired + reloadTime + scene.groups[group].delayBetweenShots;
+    deadlines.push({schedule.nextShotsFired, DeadlineVolley, group});
+}
+
+void stagedSceneGenerator::scheduleRespawn(size_t slot)
+{
+    if (spawnDelay(slot) <= 0.0)
+        return;
+
+    deadlines.push({scene.stagedPlayers[slot].lastDeath + explodeTime + spawnDelay(slot), DeadlineRespawn, slot});
+}
+
+void stagedSceneGenerator::rebuildSchedule(double now)
+{
+    deadlines = decltype(deadlines)();
+
+    for (size_t i = 0; i < groupSchedules.size(); ++i)
+        scheduleVolley(i);
+    for (size_t i = 0; i < scene.stagedPlayers.size(); ++i)
+    {
+        if (scene.stagedPlayers[i].respawnPending)
+            scheduleRespawn(i);
+    }
+    for (size_t i = 0; i < shotExpires.size(); ++i)
+    {
+        if (shotExpires[i] >= 0.0)
+            deadlines.push({shotExpires[i], DeadlineShotExpiry, i});
+    }
+    for (size_t i = 0; i < carriedExpires.size(); ++i)
+    {
+        if (carriedExpires[i] >= 0.0)
+            deadlines.push({carriedExpires[i], DeadlineCarriedShot, i});
+    }
+    if (nextSceneAt >= 0.0)
+        deadlines.push({nextSceneAt, DeadlinePlaylist, 0});
+    if (nextStatsDump >= 0.0)
+        deadlines.push({nextStatsDump, DeadlineStatsDump, 0});
+
+    updateWaitTime(now);
+}
+
+void stagedSceneGenerator::runDeadlines(double now)
+{
+    // Let each tank whose respawn delay has passed spawn again and put each expired shot back in line, in the order
+    // they are due
+    while (!deadlines.empty() && deadlines.top().time <= now)
+    {
+        Deadline deadline = deadlines.top();
+        deadlines.pop();
+
+        if (deadline.type == DeadlineVolley || deadline.type == DeadlinePlaylist || !isCurrent(deadline))
+            continue;
+
+        if (deadline.type == DeadlineStatsDump)
+        {
+            dumpStats(deadline.time);
+            nextStatsDump = deadline.time + scene.statsInterval;
+            deadlines.push({nextStatsDump, DeadlineStatsDump, 0});
+        }
+        else if (deadline.type == DeadlineRespawn)
+        {
+            StagedPlayer &stagedPlayer = scene.stagedPlayers[deadline.slot];
+            stagedPlayer.respawnPending = false;
+            bz_setPlayerSpawnable(stagedPlayer.playerID, true);
+        }
+        else if (deadline.type == DeadlineCarriedShot)
+        {
+            carriedExpires[deadline.slot] = -1.0;
+            --carriedShots;
+            --activeShots;
+        }
+        else
+        {
+            shotExpires[deadline.slot] = -1.0;
+            --activeShots;
+
+            // Shots in a group that has been turned off stay out of line until it is turned on again
+            if (!scene.groups[scene.shotTable.group[deadline.slot]].enabled)
+                continue;
+
+            waitingShots.push_back((uint32_t)deadline.slot);
+            populatedUntil = std::min(populatedUntil, deadline.time);
+        }
+    }
+}
+
+void stagedSceneGenerator::updateWaitTime(double now)
+{
+    // Throw away anything that was superseded
+    while (!deadlines.empty() && !isCurrent(deadlines.top()))
+        deadlines.pop();
+
+    // With nothing scheduled, leave it up to bzfs. Otherwise sleep until the earliest deadline. A MaxWaitTime of
+    // zero or less means no preference, so never go below a millisecond.
+    if (deadlines.empty())
+        MaxWaitTime = -1.0f;
+    else
+        MaxWaitTime = std::max(0.001f, (float)(deadlines.top().time - now));
+}
+
+static StatTimer eventTimer(bz_eEventType eventType)
+{
+    switch (eventType)
+    {
+    case bz_eGetAutoTeamEvent:
+        return TimerAutoTeam;
+    case bz_eGetPlayerSpawnPosEvent:
+        return TimerSpawnPos;
+    case bz_ePlayerSpawnEvent:
+        return TimerSpawn;
+    case bz_ePlayerDieEvent:
+        return TimerDie;
+    case bz_ePlayerUpdateEvent:
+        return TimerUpdate;
+    case bz_ePlayerPartEvent:
+        return TimerPart;
+    case bz_eTickEvent:
+        return TimerTick;
+    case bz_eBZDBChange:
+        return TimerBZDBChange;
+    default:
+        return TimerCount;
+    }
+}
+
+void stagedSceneGenerator::Event(bz_EventData *eventData)
+{
+    ScopedTimer timer(stats, eventTimer(eventData->eventType));
+
+    // Our own _shotSpeed changes come back as events, and a replay makes those again on its own
+    if (recorder.isOpen() && !(eventData->eventType == bz_eBZDBChange && changingShotSpeed))
+        recorder.event(eventData);
+
+    switch(eventData->eventType)
+    {
+    case bz_eGetAutoTeamEvent:
+    {
+        bz_GetAutoTeamEventData_V1* data = (bz_GetAutoTeamEventData_V1*)eventData;
+        // Ignore clients joining as observer
+        if (data->team != eObservers)
+        {
+            log.messagef(2, "INFO: Requested team for %d is %d", data->playerID, data->team);
+            // Take the first staged player that does not have an associated player
+            if (!freeSlots.empty())
+            {
+                size_t slot = freeSlots.top();
+                freeSlots.pop();
+
+                log.messagef(2, "INFO: Found available staged player for %d", data->playerID);
+                assignSlot(slot, data->playerID);
+                data->team = scene.stagedPlayers[slot].team;
+                data->handled = true;
+            }
+
+            // If all the staged players are ... staged ... then just make this player an observer.
+            // This has the positive side effect of also making extra -solo bots go away.
+            if (!data->handled)
+            {
+                log.messagef(0, "WARNING: No available staged player for %d, so assigning observer", data->playerID);
+                data->team = eObservers;
+                data->handled = true;
+            }
+        }
+        break;
+    }
+
+    case bz_eGetPlayerSpawnPosEvent:
+    {
+        bz_GetPlayerSpawnPosEventData_V1* data = (bz_GetPlayerSpawnPosEventData_V1*)eventData;
+
+        // See if this is a staged player
+        int slot = findSlot(data->playerID);
+        if (slot < 0)
+            break;
+
+        const StagedPlayer &stagedPlayer = scene.stagedPlayers[slot];
+
+        log.messagef(2, "INFO: Spawning staged player %d", data->playerID);
+
+        // If this isn't a random spawn, set the position and rotation
+        if (!stagedPlayer.random)
+        {
+            data->pos[0] = stagedPlayer.pos[0];
+            data->pos[1] = stagedPlayer.pos[1];
+            data->pos[2] = stagedPlayer.pos[2];
+            data->rot = stagedPlayer.rot * M_PI / 180.0f;
+        }
+
+        // Spawn the tank slightly in the air. For scene.mode static1, this ensures that it won't be moving around.
+        // For other modes, it helps ensure that tanks aren't getting stuck in objects.
+        data->pos[2] += 0.01;
+
+        data->handled = true;
+        break;
+    }
+
+    case bz_ePlayerSpawnEvent:
+    {
+        bz_PlayerSpawnEventData_V1* data = (bz_PlayerSpawnEventData_V1*)eventData;
+
+        int slot = findSlot(data->playerID);
+
+        // A bot that joined while its group is turned off only gets to spawn once the group is turned on
+        if (slot >= 0 && !scene.groups[scene.stagedPlayers[slot].group].enabled)
+        {
+            holdTank(slot);
+            break;
+        }
+
+        if (slot >= 0)
+        {
+            StagedPlayer &stagedPlayer = scene.stagedPlayers[slot];
+            stagedPlayer.alive = true;
+            stagedPlayer.driftAnchorSet = false;
+            stagedPlayer.driftRespawn = false;
+            if (stagedPlayer.diedAt >= 0.0)
+            {
+                stats.count(CounterRespawns);
+                stats.record(TimerRespawn, (uint64_t)((data->eventTime - stagedPlayer.diedAt) * 1.0e9));
+                stagedPlayer.timeLost += data->eventTime - stagedPlayer.diedAt;
+                stagedPlayer.diedAt = -1.0;
+            }
+            updateReadiness(data->eventTime);
+        }
+
+        // Once the last tank that moved in a reload has respawned, the new scene is all there
+        if (slot >= 0 && scene.stagedPlayers[slot].reloadRespawn)
+        {
+            scene.stagedPlayers[slot].reloadRespawn = false;
+            if (reloadRespawnsPending > 0 && --reloadRespawnsPending == 0)
+            {
+                double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reloadStarted).count();
+                log.messagef(1, "INFO: Scene updated in %.2f ms", elapsed);
+                if (reloadRequestedBy != BZ_NULLUSER)
+                    bz_sendTextMessagef(BZ_SERVER, reloadRequestedBy, "Scene updated in %.2f ms", elapsed);
+            }
+        }
+
+        if (slot < 0 || spawnDelay(slot) == 0.0)
+            break;
+
+        if (!scene.stagedPlayers[slot].flag.empty())
+        {
+            log.messagef(2, "INFO: Giving staged player %d the %s flag", data->playerID, scene.stagedPlayers[slot].flag.c_str());
+
+            bz_givePlayerFlag(data->playerID, scene.stagedPlayers[slot].flag.c_str(), false);
+        }
+
+        break;
+    }
+
+    case bz_ePlayerDieEvent:
+    {
+        bz_PlayerDieEventData_V2* data = (bz_PlayerDieEventData_V2*)eventData;
+
+        int slot = findSlot(data->playerID);
+        if (slot >= 0)
+        {
+            // Tanks killed because their group was turned off aren't missing from the scene
+            StagedPlayer &stagedPlayer = scene.stagedPlayers[slot];
+            stagedPlayer.alive = false;
+            if (!stagedPlayer.reloadRespawn && scene.groups[stagedPlayer.group].enabled)
+            {
+                ++stagedPlayer.deaths;
+                stagedPlayer.diedAt = data->eventTime;
+            }
+            updateReadiness(data->eventTime);
+        }
+
+        // Tanks that are being moved by a reload or that drifted too far come right back
+        if (slot >= 0 && spawnDelay(slot) > 0.0 && scene.groups[scene.stagedPlayers[slot].group].enabled
+            && !scene.stagedPlayers[slot].reloadRespawn
+            && !scene.stagedPlayers[slot].driftRespawn)
+        {
+            // Disable spawning so we can add a delay between the explosion ending and the respawn
+            bz_setPlayerSpawnable(data->playerID, false);
+            scene.stagedPlayers[slot].lastDeath = data->eventTime;
+            scene.stagedPlayers[slot].respawnPending = true;
+
+            scheduleRespawn(slot);
+            updateWaitTime(data->eventTime);
+        }
+        break;
+    }
+
+    case bz_ePlayerUpdateEvent:
+    {
+        // We don't need to bother with this in normal mode
+        if (scene.mode == ModeNormal)
+            break;
+
+        bz_PlayerUpdateEventData_V1* data = (bz_PlayerUpdateEventData_V1*)eventData;
+
+        // Only the living is allowed past this point.
+        if (data->state.status != eAlive)
+            break;
+
+        // Find the staged player record and keep track of how far it has drifted from where it showed up
+        int slot = findSlot(data->playerID);
+        StagedPlayer *stagedPlayer = slot >= 0 ? &scene.stagedPlayers[slot] : NULL;
+        float drift = 0.0f;
+        if (stagedPlayer != NULL)
+        {
+            if (!stagedPlayer->driftAnchorSet)
+            {
+                std::copy(data->state.pos, data->state.pos + 3, stagedPlayer->driftAnchor);
+                stagedPlayer->driftAnchorSet = true;
+            }
+            drift = hypotf(data->state.pos[0] - stagedPlayer->driftAnchor[0], data->state.pos[1] - stagedPlayer->driftAnchor[1]);
+            stagedPlayer->maxDrift = std::max(stagedPlayer->maxDrift, drift);
+        }
+
+        // With a drift tolerance, staged tanks can move a bit and are only killed once they are past it
+        bool tolerant = scene.driftTolerance > 0.0f && stagedPlayer != NULL;
+        bool moved = false;
+        if (scene.mode == ModeStatic1) {
+            // We spawn tanks in the air, and have gravity set real low. Eventually a tank might land and start
+            // moving, so kill 'em if they do.
+            if (tolerant)
+                moved = drift > scene.driftTolerance;
+            else
+                moved = data->state.velocity[0] != 0.0f || data->state.velocity[1] != 0.0f;
+        }
+        else if (scene.mode == ModeStatic2 && stagedPlayer != NULL) {
+            // If they have moved a bit from their staged position, kill 'em
+            if (tolerant)
+                moved = drift > scene.driftTolerance;
+            else
+                moved = fabs(stagedPlayer->pos[0] - data->state.pos[0]) > 0.1 || fabs(stagedPlayer->pos[1] - data->state.pos[1]) > 0.1;
+        }
+
+        if (moved)
+        {
+            log.messagef(0, "NOTE: Killing player '%s' because they moved %.2f", bz_getPlayerCallsign(data->playerID), drift);
+
+            // It's the drift that's the problem, not the tank, so put it right back without the spawn delay
+            stats.count(CounterMovementKills);
+            if (stagedPlayer != NULL)
+            {
+                ++stagedPlayer->driftKills;
+                stagedPlayer->driftRespawn = tolerant;
+            }
+            bz_killPlayer(data->playerID, false);
+        }
+        break;
+    }
+
+    case bz_ePlayerPartEvent:
+    {
+        bz_PlayerJoinPartEventData_V1* data = (bz_PlayerJoinPartEventData_V1*)eventData;
+
+        // When a player leaves, see if they were assigned to a staged player and release them
+        int slot = findSlot(data->playerID);
+        if (slot >= 0)
+        {
+            if (scene.stagedPlayers[slot].reloadRespawn && reloadRespawnsPending > 0)
+                --reloadRespawnsPending;
+            scene.stagedPlayers[slot].reloadRespawn = false;
+
+            releaseSlot(slot);
+            adoptParkedBot(slot);
+            updateReadiness(data->eventTime);
+        }
+        else
+            parkedBots.erase(std::remove(parkedBots.begin(), parkedBots.end(), data->playerID), parkedBots.end());
+
+        break;
+    }
+
+    case bz_eTickEvent:
+    {
+        bz_TickEventData_V1* data = (bz_TickEventData_V1*)eventData;
+
+        if (worldPending)
+        {
+            worldPending = false;
+            prepareScene(scene);
+            advanceShots();
+        }
+
+        runDeadlines(data->eventTime);
+
+        if (nextSceneAt >= 0.0 && data->eventTime >= nextSceneAt)
+            nextPlaylistScene(data->eventTime);
+
+        trackCoverage(data->eventTime);
+
+        // I'ma firing my BLAAAAARRRR
+        if (scene.refireMode == RefireContinuous)
+            refireShots(data->eventTime);
+        else
+        {
+            for (size_t i = 0; i < groupSchedules.size(); ++i)
+            {
+                GroupSchedule &schedule = groupSchedules[i];
+                if (schedule.shotCount == 0 || !scene.groups[i].enabled || data->eventTime < schedule.nextShotsFired)
+                    continue;
+
+                schedule.lastShotsFired = data->eventTime;
+                fireVolley(i, data->eventTime);
+                scheduleVolley(i);
+            }
+        }
+
+        updateReadiness(data->eventTime);
+        updateWaitTime(data->eventTime);
+        log.flush();
+        recorder.tick(data->eventTime);
+        break;
+    }
+
+    case bz_eBZDBChange:
+    {
+        if (changingShotSpeed)
+            break;
+
+        bz_BZDBChangeData_V1* data = (bz_BZDBChangeData_V1*)eventData;
+        refreshBZDBValue(data->key.c_str(), atof(data->value.c_str()));
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    // Record the team and spawn position we picked, so a replay can check it picks the same
+    if (recorder.isOpen())
+        recorder.result(eventData);
+}
+
+bool stagedSceneGenerator::SlashCommand ( int playerID, bz_ApiString /*cmd*/, bz_ApiString, bz_APIStringList* cmdParams )
+{
+    std::string subcommand = makelower(cmdParams->get(0).c_str());
+
+    // Commands change the scene, so a replay has to run them at the same time
+    if (recorder.isOpen())
+    {
+        std::string commandLine = "scene";
+        for (unsigned int i = 0; i < cmdParams->size(); ++i)
+            commandLine += std::string(" ") + cmdParams->get(i).c_str();
+        recorder.command(bz_getCurrentTime(), playerID, commandLine);
+    }
+
+    if (subcommand == "reset") {
+        for (auto &stagedPlayer : scene.stagedPlayers)
+        {
+            if (stagedPlayer.playerID > -1 && scene.groups[stagedPlayer.group].enabled)
+                bz_killPlayer(stagedPlayer.playerID, false);
+        }
+    }
+    else if (subcommand == "shots") {
+        // Shots from groups that were turned off can still be finishing their flight, but they don't count
+        size_t inFlight = populatedUntil > bz_getCurrentTime() ? enabledShots : 0;
+        if (scene.refireMode == RefireContinuous)
+        {
+            inFlight = 0;
+            for (size_t i = 0; i < shotExpires.size(); ++i)
+            {
+                if (shotExpires[i] >= 0.0 && scene.groups[scene.shotTable.group[i]].enabled)
+                    ++inFlight;
+            }
+        }
+        bz_sendTextMessagef(BZ_SERVER, playerID, "%u of %u staged shots in flight (%s refire, %u slots)",
+                            (unsigned)inFlight, (unsigned)enabledShots, scene.refireMode == RefireContinuous ? "continuous" : "volley", (unsigned)scene.maxShots);
+        if (coverageObserved > 0.0)
+            bz_sendTextMessagef(BZ_SERVER, playerID, "Scene fully populated %.1f%% of the last %.0f seconds",
+                                100.0 * coveragePopulated / coverageObserved, coverageObserved);
+    }
+    else if (subcommand == "load" || subcommand == "reload") {
+        // This reads files on the server, so it needs the same permission as changing any server variable
+        if (playerID != BZ_SERVER && !bz_hasPerm(playerID, "setAll"))
+            bz_sendTextMessage(BZ_SERVER, playerID, "You do not have permission to load scenes");
+        else if (subcommand == "load" && cmdParams->size() < 2)
+            bz_sendTextMessage(BZ_SERVER, playerID, "Usage: /scene load <file>");
+        else
+        {
+            // Loading a scene by hand takes over from a running playlist
+            if (!playlist.empty())
+                stopPlaylist(bz_getCurrentTime());
+            loadScene(playerID, subcommand == "load" ? std::string(cmdParams->get(1).c_str()) : sceneFile);
+        }
+    }
+    else if (subcommand == "stats") {
+        std::string action = cmdParams->size() > 1 ? makelower(cmdParams->get(1).c_str()) : "";
+        if (action == "reset")
+        {
+            stats.reset();
+            bz_sendTextMessage(BZ_SERVER, playerID, "Stats reset");
+        }
+        else if (action == "dump")
+        {
+            if (scene.statsFile.empty())
+                bz_sendTextMessage(BZ_SERVER, playerID, "There is no StatsFile to dump the stats to");
+            else
+            {
+                dumpStats(bz_getCurrentTime());
+                bz_sendTextMessagef(BZ_SERVER, playerID, "Stats written to %s", scene.statsFile.c_str());
+            }
+        }
+        else
+        {
+            for (auto &line : stats.summary())
+                bz_sendTextMessage(BZ_SERVER, playerID, line.c_str());
+        }
+    }
+    else if (subcommand == "drift") {
+        // The tanks that cost the scene the most time are the ones whose placement most needs fixing
+        std::vector<const StagedPlayer*> worst;
+        unsigned int deaths = 0, driftKills = 0;
+        double timeLost = 0.0;
+        for (auto &stagedPlayer : scene.stagedPlayers)
+        {
+            deaths += stagedPlayer.deaths;
+            driftKills += stagedPlayer.driftKills;
+            timeLost += stagedPlayer.timeLost;
+            if (stagedPlayer.deaths > 0)
+                worst.push_back(&stagedPlayer);
+        }
+        std::sort(worst.begin(), worst.end(), [](const StagedPlayer *a, const StagedPlayer *b) {
+            return a->timeLost > b->timeLost;
+        });
+
+        bz_sendTextMessagef(BZ_SERVER, playerID, "%u deaths (%u for drifting) cost %.1f seconds", deaths, driftKills, timeLost);
+        for (size_t i = 0; i < worst.size() && i < 10; ++i)
+            bz_sendTextMessagef(BZ_SERVER, playerID, "  %s: %u deaths (%u for drifting), %.1f seconds lost, drifted up to %.2f",
+                                worst[i]->sectionName.c_str(), worst[i]->deaths, worst[i]->driftKills, worst[i]->timeLost,
+                                worst[i]->maxDrift);
+    }
+    else if (subcommand == "status") {
+        double now = bz_getCurrentTime();
+        if (isSceneReady(now))
+            bz_sendTextMessagef(BZ_SERVER, playerID, "Scene ready (generation %u)", readyGeneration);
+        else
+        {
+            unsigned int alive = 0, staged = 0;
+            for (auto &stagedPlayer : scene.stagedPlayers)
+            {
+                if (!scene.groups[stagedPlayer.group].enabled)
+                    continue;
+                ++staged;
+                if (stagedPlayer.playerID >= 0 && stagedPlayer.alive)
+                    ++alive;
+            }
+            bz_sendTextMessagef(BZ_SERVER, playerID, "Scene not ready (generation %u): %u of %u tanks alive, shots %s",
+                                readyGeneration, alive, staged,
+                                (enabledShots == 0 || populatedUntil > now) ? "in flight" : "not in flight");
+        }
+    }
+    else if (subcommand == "group") {
+        std::string action = cmdParams->size() > 1 ? makelower(cmdParams->get(1).c_str()) : "";
+        std::string name = cmdParams->size() > 2 ? makelower(cmdParams->get(2).c_str()) : "";
+        int group = scene.findGroup(name);
+
+        if (action.empty())
+            reportGroups(playerID, bz_getCurrentTime());
+        else if ((action != "on" && action != "off") || name.empty())
+            bz_sendTextMessage(BZ_SERVER, playerID, "Usage: /scene group [on|off <name>]");
+        else if (playerID != BZ_SERVER && !bz_hasPerm(playerID, "setAll"))
+            bz_sendTextMessage(BZ_SERVER, playerID, "You do not have permission to change the scene");
+        else if (group < 0)
+            bz_sendTextMessagef(BZ_SERVER, playerID, "There is no group named %s", name.c_str());
+        else
+        {
+            setGroupEnabled(group, action == "on", bz_getCurrentTime());
+            bz_sendTextMessagef(BZ_SERVER, playerID, "Group %s is %s", scene.groups[group].name.c_str(), action.c_str());
+        }
+    }
+    else if (subcommand == "playlist") {
+        std::string file = cmdParams->size() > 1 ? cmdParams->get(1).c_str() : "";
+
+        if (file.empty())
+        {
+            if (playlist.empty())
+                bz_sendTextMessage(BZ_SERVER, playerID, "No playlist is running");
+            else if (playlistWaiting)
+                bz_sendTextMessagef(BZ_SERVER, playerID, "Waiting for %s to be ready to start a playlist of %u scenes",
+                                    sceneFile.c_str(), (unsigned)playlist.size());
+            else
+            {
+                bz_sendTextMessagef(BZ_SERVER, playerID, "Showing %s, scene %u of %u",
+                                    sceneFile.c_str(), (unsigned)playlistPosition, (unsigned)playlist.size());
+                reportPlaylist(playerID, bz_getCurrentTime());
+            }
+        }
+        else if (playerID != BZ_SERVER && !bz_hasPerm(playerID, "setAll"))
+            bz_sendTextMessage(BZ_SERVER, playerID, "You do not have permission to load scenes");
+        else if (makelower(file.c_str()) == "stop")
+        {
+            if (!playlist.empty())
+            {
+                reportPlaylist(playerID, bz_getCurrentTime());
+                stopPlaylist(bz_getCurrentTime());
+            }
         }
+        else if (!readPlaylist(file))
+            bz_sendTextMessagef(BZ_SERVER, playerID, "Unable to read the playlist %s, see the server log", file.c_str());
+        else
+            startPlaylist(playerID, bz_getCurrentTime());
     }
     else {
-        bz_sendTextMessage(BZ_SERVER, playerID, "Usage: /scene reset");
+        bz_sendTextMessage(BZ_SERVER, playerID, "Usage: /scene reset|shots|status|drift|stats [reset|dump]|group [on|off <name>]|load <file>|reload|playlist [<file>|stop]");
     }
 
     return true;
@@ -0,0 +1,188 @@
+// stagedSceneGenerator
+// Counters and latency histograms for what the plugin costs the server. See
+// README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "stagedStats.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+
+void LatencyHistogram::add(uint64_t nanoseconds)
+{
+    ++count;
+    totalNanoseconds += nanoseconds;
+    if (nanoseconds > maxNanoseconds)
+        maxNanoseconds = nanoseconds;
+
+    int bucket = 0;
+    for (uint64_t microseconds = nanoseconds / 1000; microseconds > 1 && bucket < BucketCount - 1; microseconds >>= 1)
+        ++bucket;
+    ++buckets[bucket];
+}
+
+double LatencyHistogram::percentile(double fraction) const
+{
+    if (count == 0)
+        return 0.0;
+
+    uint64_t wanted = (uint64_t)(fraction * count);
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < BucketCount; ++bucket)
+    {
+        seen += buckets[bucket];
+        if (seen > wanted)
+            return std::min((double)(2ull << bucket), maxNanoseconds / 1000.0);
+    }
+    return maxNanoseconds / 1000.0;
+}
+
+void SceneStats::reset()
+{
+    *this = SceneStats();
+}
+
+const char* SceneStats::counterName(int counter)
+{
+    static const char* names[CounterCount] = {"shots_fired", "bzdb_writes", "movement_kills", "respawns"};
+    return names[counter];
+}
+
+const char* SceneStats::timerName(int timer)
+{
+    static const char* names[TimerCount] = {
+        "auto_team", "spawn_pos", "spawn", "die", "update", "part", "tick", "bzdb_change", "volley", "respawn"
+    };
+    return names[timer];
+}
+
+std::vector<std::string> SceneStats::summary() const
+{
+    std::vector<std::string> lines;
+    char line[256];
+
+    double seconds = (now() - started) / 1.0e9;
+    snprintf(line, sizeof(line), "Over %.0f seconds: %llu shots fired, %llu BZDB writes, %llu movement kills, %llu respawns",
+             seconds, (unsigned long long)counters[CounterShotsFired], (unsigned long long)counters[CounterBZDBWrites],
+             (unsigned long long)counters[CounterMovementKills], (unsigned long long)counters[CounterRespawns]);
+    lines.push_back(line);
+
+    for (int timer = 0; timer < TimerCount; ++timer)
+    {
+        const LatencyHistogram &histogram = timers[timer];
+        if (histogram.count == 0)
+            continue;
+
+        snprintf(line, sizeof(line), "  %s: %llu, mean %.1f us, p50 < %.0f us, p99 < %.0f us, max %.1f us", timerName(timer),
+                 (unsigned long long)histogram.count, histogram.meanMicroseconds(), histogram.percentile(0.5),
+                 histogram.percentile(0.99), histogram.maxNanoseconds / 1000.0);
+        lines.push_back(line);
+    }
+
+    return lines;
+}
+
+bool SceneStats::dump(const std::string &fileName, double serverTime) const
+{
+    if (fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0)
+        return writeJSON(fileName, serverTime);
+    return appendCSV(fileName, serverTime);
+}
+
+bool SceneStats::appendCSV(const std::string &fileName, double serverTime) const
+{
+    // Only a new file gets the header row
+    bool exists = std::ifstream(fileName.c_str()).good();
+    std::ofstream out(fileName.c_str(), std::ios::out | std::ios::app);
+    if (!out)
+        return false;
+
+    if (!exists)
+    {
+        out << "time";
+        for (int counter = 0; counter < CounterCount; ++counter)
+            out << ',' << counterName(counter);
+        for (int timer = 0; timer < TimerCount; ++timer)
+        {
+            out << ',' << timerName(timer) << "_count," << timerName(timer) << "_mean_us," << timerName(timer) << "_p99_us,"
+                << timerName(timer) << "_max_us";
+        }
+        out << '\n';
+    }
+
+    out << serverTime;
+    for (int counter = 0; counter < CounterCount; ++counter)
+        out << ',' << counters[counter];
+    for (int timer = 0; timer < TimerCount; ++timer)
+    {
+        const LatencyHistogram &histogram = timers[timer];
+        out << ',' << histogram.count << ',' << histogram.meanMicroseconds() << ',' << histogram.percentile(0.99) << ','
+            << histogram.maxNanoseconds / 1000.0;
+    }
+    out << '\n';
+
+    return out.good();
+}
+
+bool SceneStats::writeJSON(const std::string &fileName, double serverTime) const
+{
+    std::ofstream out(fileName.c_str(), std::ios::out | std::ios::trunc);
+    if (!out)
+        return false;
+
+    out << "{\n  \"time\": " << serverTime << ",\n  \"counters\": {";
+    for (int counter = 0; counter < CounterCount; ++counter)
+        out << (counter > 0 ? ", " : " ") << '"' << counterName(counter) << "\": " << counters[counter];
+    out << " },\n  \"timers\": {\n";
+    for (int timer = 0; timer < TimerCount; ++timer)
+    {
+        const LatencyHistogram &histogram = timers[timer];
+        out << "    \"" << timerName(timer) << "\": { \"count\": " << histogram.count << ", \"mean_us\": "
+            << histogram.meanMicroseconds() << ", \"p50_us\": " << histogram.percentile(0.5) << ", \"p99_us\": "
+            << histogram.percentile(0.99) << ", \"max_us\": " << histogram.maxNanoseconds / 1000.0 << ", \"buckets\": [";
+        for (int bucket = 0; bucket < LatencyHistogram::BucketCount; ++bucket)
+            out << (bucket > 0 ? ", " : "") << histogram.buckets[bucket];
+        out << "] }" << (timer + 1 < TimerCount ? "," : "") << '\n';
+    }
+    out << "  }\n}\n";
+
+    return out.good();
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
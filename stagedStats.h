@@ -0,0 +1,153 @@
+// stagedSceneGenerator
+// Counters and latency histograms for what the plugin costs the server. See
+// README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#ifndef STAGED_STATS_H
+#define STAGED_STATS_H
+
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum StatCounter {
+    CounterShotsFired,
+    CounterBZDBWrites,
+    CounterMovementKills,
+    CounterRespawns,
+    CounterCount
+};
+
+// One timer for each event the plugin handles, plus the volleys and the time from a tank dying to it spawning again
+enum StatTimer {
+    TimerAutoTeam,
+    TimerSpawnPos,
+    TimerSpawn,
+    TimerDie,
+    TimerUpdate,
+    TimerPart,
+    TimerTick,
+    TimerBZDBChange,
+    TimerVolley,
+    TimerRespawn,
+    TimerCount
+};
+
+// Bucket b counts the samples from 2^b up to 2^(b + 1) microseconds, so adding a sample is a couple of instructions
+struct LatencyHistogram
+{
+    static const int BucketCount = 32;
+
+    uint64_t count = 0;
+    uint64_t totalNanoseconds = 0;
+    uint64_t maxNanoseconds = 0;
+    uint64_t buckets[BucketCount] = {};
+
+    void add(uint64_t nanoseconds);
+
+    // The upper edge of the bucket the percentile falls in (or the max if that's lower), in microseconds
+    double percentile(double fraction) const;
+
+    double meanMicroseconds() const
+    {
+        return count > 0 ? totalNanoseconds / 1000.0 / count : 0.0;
+    }
+};
+
+class SceneStats
+{
+public:
+    static uint64_t now()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void count(StatCounter counter, uint64_t amount = 1)
+    {
+        counters[counter] += amount;
+    }
+
+    void record(StatTimer timer, uint64_t nanoseconds)
+    {
+        timers[timer].add(nanoseconds);
+    }
+
+    void reset();
+
+    // One line per counter group and per timer that has samples, for /scene stats
+    std::vector<std::string> summary() const;
+
+    // CSV files get a row added on each dump, and JSON files are replaced with the latest numbers
+    bool dump(const std::string &fileName, double serverTime) const;
+
+    static const char* counterName(int counter);
+    static const char* timerName(int timer);
+
+private:
+    bool appendCSV(const std::string &fileName, double serverTime) const;
+    bool writeJSON(const std::string &fileName, double serverTime) const;
+
+    uint64_t counters[CounterCount] = {};
+    LatencyHistogram timers[TimerCount];
+    uint64_t started = now();
+};
+
+// Times the enclosing block. TimerCount can be passed to time nothing.
+class ScopedTimer
+{
+public:
+    ScopedTimer(SceneStats &stats, StatTimer timer) : stats(stats), timer(timer), started(SceneStats::now())
+    {
+    }
+
+    ~ScopedTimer()
+    {
+        if (timer != TimerCount)
+            stats.record(timer, SceneStats::now() - started);
+    }
+
+private:
+    SceneStats &stats;
+    StatTimer timer;
+    uint64_t started;
+};
+
+#endif // STAGED_STATS_H
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
@@ -0,0 +1,611 @@
+// stagedSceneGenerator
+// The world obstacles that staged shots ricochet off of, used to work out where a
+// shot is after it has bounced. See README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#include "stagedWorld.h"
+#include "bzfsAPI.h"
+#include "plugin_utils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <math.h>
+#include <sstream>
+#include <string>
+
+namespace
+{
+// Leaves hold at most this many obstacles
+const uint32_t LeafSize = 4;
+
+// Shots are moved this far off of the surface they bounced off so they don't hit it again
+const float BounceOffset = 0.01f;
+
+const float MaxTraceDistance = 1.0e6f;
+
+const float TouchTolerance = 0.01f;
+
+float dot(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+void cross(const float a[3], const float b[3], float out[3])
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Distance along the ray to where it enters the box, if it does before maxDistance
+bool hitBounds(const float min[3], const float max[3], const float origin[3], const float inverseDir[3],
+               float maxDistance)
+{
+    float enter = 0.0f, exit = maxDistance;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float near = (min[axis] - origin[axis]) * inverseDir[axis];
+        float far = (max[axis] - origin[axis]) * inverseDir[axis];
+        if (near > far)
+            std::swap(near, far);
+        enter = std::max(enter, near);
+        exit = std::min(exit, far);
+        if (enter > exit)
+            return false;
+    }
+    return true;
+}
+
+bool overlapBounds(const float minA[3], const float maxA[3], const float minB[3], const float maxB[3])
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (minA[axis] > maxB[axis] || maxA[axis] < minB[axis])
+            return false;
+    }
+    return true;
+}
+}
+
+void StagedWorld::setWorldSize(float size)
+{
+    worldHalfSize = size / 2.0f;
+}
+
+void StagedWorld::addBox(const float center[3], const float halfSize[3], float rotation)
+{
+    Primitive primitive;
+    primitive.isBox = true;
+    std::copy(center, center + 3, primitive.center);
+    std::copy(halfSize, halfSize + 3, primitive.halfSize);
+    primitive.cosRotation = (float)cos(rotation * M_PI / 180.0);
+    primitive.sinRotation = (float)sin(rotation * M_PI / 180.0);
+
+    // The bounds of the rotated box
+    float extentX = fabsf(primitive.cosRotation) * halfSize[0] + fabsf(primitive.sinRotation) * halfSize[1];
+    float extentY = fabsf(primitive.sinRotation) * halfSize[0] + fabsf(primitive.cosRotation) * halfSize[1];
+    primitive.min[0] = center[0] - extentX;
+    primitive.max[0] = center[0] + extentX;
+    primitive.min[1] = center[1] - extentY;
+    primitive.max[1] = center[1] + extentY;
+    primitive.min[2] = center[2] - halfSize[2];
+    primitive.max[2] = center[2] + halfSize[2];
+
+    primitives.push_back(primitive);
+}
+
+void StagedWorld::addTriangle(const float a[3], const float b[3], const float c[3])
+{
+    Primitive primitive;
+    primitive.isBox = false;
+    std::copy(a, a + 3, primitive.vertex[0]);
+    std::copy(b, b + 3, primitive.vertex[1]);
+    std::copy(c, c + 3, primitive.vertex[2]);
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        primitive.min[axis] = std::min(std::min(a[axis], b[axis]), c[axis]);
+        primitive.max[axis] = std::max(std::max(a[axis], b[axis]), c[axis]);
+    }
+
+    primitives.push_back(primitive);
+}
+
+void StagedWorld::build()
+{
+    nodes.clear();
+    if (primitives.empty())
+        return;
+
+    nodes.reserve(2 * primitives.size() / LeafSize + 1);
+    buildNode(0, (uint32_t)primitives.size());
+}
+
+uint32_t StagedWorld::buildNode(uint32_t start, uint32_t count)
+{
+    uint32_t index = (uint32_t)nodes.size();
+    nodes.push_back(Node());
+
+    Node node;
+    std::copy(primitives[start].min, primitives[start].min + 3, node.min);
+    std::copy(primitives[start].max, primitives[start].max + 3, node.max);
+    float centerMin[3], centerMax[3];
+    for (int axis = 0; axis < 3; ++axis)
+        centerMin[axis] = centerMax[axis] = primitives[start].min[axis] + primitives[start].max[axis];
+
+    for (uint32_t i = start + 1; i < start + count; ++i)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            node.min[axis] = std::min(node.min[axis], primitives[i].min[axis]);
+            node.max[axis] = std::max(node.max[axis], primitives[i].max[axis]);
+            float center = primitives[i].min[axis] + primitives[i].max[axis];
+            centerMin[axis] = std::min(centerMin[axis], center);
+            centerMax[axis] = std::max(centerMax[axis], center);
+        }
+    }
+    node.start = start;
+    node.count = count;
+    node.right = 0;
+
+    if (count > LeafSize)
+    {
+        // Split at the median along the axis the obstacles are most spread out on
+        int axis = 0;
+        for (int i = 1; i < 3; ++i)
+        {
+            if (centerMax[i] - centerMin[i] > centerMax[axis] - centerMin[axis])
+                axis = i;
+        }
+
+        uint32_t half = count / 2;
+        std::nth_element(primitives.begin() + start, primitives.begin() + start + half, primitives.begin() + start + count,
+                         [axis](const Primitive &a, const Primitive &b) {
+            return a.min[axis] + a.max[axis] < b.min[axis] + b.max[axis];
+        });
+
+        node.count = 0;
+        buildNode(start, half);
+        node.right = buildNode(start + half, count - half);
+    }
+
+    nodes[index] = node;
+    return index;
+}
+
+bool StagedWorld::hitPrimitive(const Primitive &primitive, const float origin[3], const float dir[3], float maxDistance,
+                               WorldHit &hit) const
+{
+    if (primitive.isBox)
+    {
+        // Turn the ray into the box's frame so it can be tested like an axis aligned box
+        float relative[3] = {origin[0] - primitive.center[0], origin[1] - primitive.center[1], origin[2] - primitive.center[2]};
+        float localOrigin[3] = {
+            relative[0] * primitive.cosRotation + relative[1] * primitive.sinRotation,
+            -relative[0] * primitive.sinRotation + relative[1] * primitive.cosRotation,
+            relative[2]
+        };
+        float localDir[3] = {
+            dir[0] * primitive.cosRotation + dir[1] * primitive.sinRotation,
+            -dir[0] * primitive.sinRotation + dir[1] * primitive.cosRotation,
+            dir[2]
+        };
+
+        float enter = -MaxTraceDistance, exit = maxDistance;
+        int enterAxis = -1;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (localDir[axis] == 0.0f)
+            {
+                if (fabsf(localOrigin[axis]) > primitive.halfSize[axis])
+                    return false;
+                continue;
+            }
+
+            float near = (-primitive.halfSize[axis] - localOrigin[axis]) / localDir[axis];
+            float far = (primitive.halfSize[axis] - localOrigin[axis]) / localDir[axis];
+            if (near > far)
+                std::swap(near, far);
+            if (near > enter)
+            {
+                enter = near;
+                enterAxis = axis;
+            }
+            exit = std::min(exit, far);
+        }
+
+        // Shots that start inside of a box don't hit it
+        if (enterAxis < 0 || enter > exit || enter <= 0.0f || enter >= maxDistance)
+            return false;
+
+        float localNormal[3] = {0.0f, 0.0f, 0.0f};
+        localNormal[enterAxis] = localDir[enterAxis] > 0.0f ? -1.0f : 1.0f;
+        hit.normal[0] = localNormal[0] * primitive.cosRotation - localNormal[1] * primitive.sinRotation;
+        hit.normal[1] = localNormal[0] * primitive.sinRotation + localNormal[1] * primitive.cosRotation;
+        hit.normal[2] = localNormal[2];
+        hit.distance = enter;
+        return true;
+    }
+
+    // Möller-Trumbore
+    float edge1[3], edge2[3], p[3], q[3], s[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        edge1[axis] = primitive.vertex[1][axis] - primitive.vertex[0][axis];
+        edge2[axis] = primitive.vertex[2][axis] - primitive.vertex[0][axis];
+        s[axis] = origin[axis] - primitive.vertex[0][axis];
+    }
+    cross(dir, edge2, p);
+    float determinant = dot(edge1, p);
+    if (fabsf(determinant) < 1.0e-8f)
+        return false;
+
+    float u = dot(s, p) / determinant;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    cross(s, edge1, q);
+    float v = dot(dir, q) / determinant;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    float distance = dot(edge2, q) / determinant;
+    if (distance <= 0.0f || distance >= maxDistance)
+        return false;
+
+    cross(edge1, edge2, hit.normal);
+    float length = sqrtf(dot(hit.normal, hit.normal));
+    for (int axis = 0; axis < 3; ++axis)
+        hit.normal[axis] /= length;
+    hit.distance = distance;
+    return true;
+}
+
+bool StagedWorld::trace(const float origin[3], const float dir[3], float maxDistance, WorldHit &hit) const
+{
+    hit.distance = maxDistance;
+    hit.ground = false;
+    bool found = false;
+
+    // The ground and the outer walls
+    if (dir[2] < 0.0f && -origin[2] / dir[2] < hit.distance)
+    {
+        hit.distance = -origin[2] / dir[2];
+        hit.normal[0] = hit.normal[1] = 0.0f;
+        hit.normal[2] = 1.0f;
+        hit.ground = true;
+        found = true;
+    }
+    for (int axis = 0; worldHalfSize > 0.0f && axis < 2; ++axis)
+    {
+        if (dir[axis] == 0.0f)
+            continue;
+
+        float wall = dir[axis] > 0.0f ? worldHalfSize : -worldHalfSize;
+        float distance = (wall - origin[axis]) / dir[axis];
+        if (distance > 0.0f && distance < hit.distance)
+        {
+            hit.distance = distance;
+            hit.normal[0] = hit.normal[1] = hit.normal[2] = 0.0f;
+            hit.normal[axis] = dir[axis] > 0.0f ? -1.0f : 1.0f;
+            hit.ground = false;
+            found = true;
+        }
+    }
+
+    if (!nodes.empty())
+    {
+        float inverseDir[3];
+        for (int axis = 0; axis < 3; ++axis)
+            inverseDir[axis] = 1.0f / dir[axis];
+
+        uint32_t stack[64];
+        int depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0)
+        {
+            const Node &node = nodes[stack[--depth]];
+            if (!hitBounds(node.min, node.max, origin, inverseDir, hit.distance))
+                continue;
+
+            if (node.count == 0)
+            {
+                stack[depth++] = node.right;
+                stack[depth++] = (uint32_t)(&node - &nodes[0]) + 1;
+                continue;
+            }
+
+            for (uint32_t i = node.start; i < node.start + node.count; ++i)
+            {
+                WorldHit candidate;
+                if (hitPrimitive(primitives[i], origin, dir, hit.distance, candidate))
+                {
+                    std::copy(candidate.normal, candidate.normal + 3, hit.normal);
+                    hit.distance = candidate.distance;
+                    hit.ground = false;
+                    found = true;
+                }
+            }
+        }
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+        hit.point[axis] = origin[axis] + dir[axis] * hit.distance;
+    return found;
+}
+
+bool StagedWorld::blocksCylinder(const float base[3], float radius, float height) const
+{
+    if (worldHalfSize > 0.0f && (fabsf(base[0]) + radius > worldHalfSize || fabsf(base[1]) + radius > worldHalfSize))
+        return true;
+
+    // Resting right on top of an obstacle doesn't count as touching it
+    const float min[3] = {base[0] - radius, base[1] - radius, base[2] + TouchTolerance};
+    const float max[3] = {base[0] + radius, base[1] + radius, base[2] + height - TouchTolerance};
+
+    uint32_t stack[64];
+    int depth = 0;
+    if (!nodes.empty())
+        stack[depth++] = 0;
+    while (depth > 0)
+    {
+        const Node &node = nodes[stack[--depth]];
+        if (!overlapBounds(node.min, node.max, min, max))
+            continue;
+
+        if (node.count == 0)
+        {
+            stack[depth++] = node.right;
+            stack[depth++] = (uint32_t)(&node - &nodes[0]) + 1;
+            continue;
+        }
+
+        for (uint32_t i = node.start; i < node.start + node.count; ++i)
+        {
+            const Primitive &primitive = primitives[i];
+            if (!overlapBounds(primitive.min, primitive.max, min, max))
+                continue;
+            if (!primitive.isBox)
+                return true;
+
+            // The closest point of the rotated box to the middle of the cylinder
+            float relativeX = base[0] - primitive.center[0], relativeY = base[1] - primitive.center[1];
+            float localX = relativeX * primitive.cosRotation + relativeY * primitive.sinRotation;
+            float localY = -relativeX * primitive.sinRotation + relativeY * primitive.cosRotation;
+            float outsideX = std::max(0.0f, fabsf(localX) - primitive.halfSize[0]);
+            float outsideY = std::max(0.0f, fabsf(localY) - primitive.halfSize[1]);
+            if (outsideX * outsideX + outsideY * outsideY < radius * radius)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+bool StagedWorld::ricochet(float pos[3], float dir[3], int bounces) const
+{
+    for (int bounce = 0; bounce < bounces; ++bounce)
+    {
+        WorldHit hit;
+        if (!trace(pos, dir, MaxTraceDistance, hit) || hit.ground)
+            return false;
+
+        float along = 2.0f * dot(dir, hit.normal);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            dir[axis] -= along * hit.normal[axis];
+            pos[axis] = hit.point[axis] + dir[axis] * BounceOffset;
+        }
+    }
+
+    return true;
+}
+
+bool StagedWorld::readWorldFile(const char* worldFile)
+{
+    std::ifstream file(worldFile);
+    if (!file)
+    {
+        bz_debugMessagef(0, "ERROR: Unable to open the world file %s", worldFile);
+        return false;
+    }
+
+    // BZFlag's default world is 800 units across
+    worldHalfSize = 400.0f;
+
+    std::string block, line;
+    float pos[3], size[3], rotation = 0.0f;
+    bool flipZ = false;
+    int nestedDepth = 0;
+    std::vector<float> vertices;
+    std::vector<std::vector<int>> faces;
+    std::map<std::string, int> skipped;
+
+    while (std::getline(file, line))
+    {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+
+        std::istringstream words(line);
+        std::string keyword;
+        if (!(words >> keyword))
+            continue;
+        keyword = makelower(keyword.c_str());
+
+        if (block.empty())
+        {
+            block = keyword;
+            pos[0] = pos[1] = pos[2] = 0.0f;
+            size[0] = size[1] = size[2] = 1.0f;
+            rotation = 0.0f;
+            flipZ = false;
+            nestedDepth = 0;
+            vertices.clear();
+            faces.clear();
+            continue;
+        }
+
+        // Groups of obstacles are skipped as a whole since they're only placed by a group
+        if (block == "define")
+        {
+            if (keyword == "enddef")
+            {
+                ++skipped[block];
+                block.clear();
+            }
+            continue;
+        }
+
+        // Mesh draw info has its own blocks inside of the mesh
+        if (keyword == "drawinfo" || (nestedDepth > 0 && (keyword == "lod" || keyword == "matref")))
+        {
+            ++nestedDepth;
+            continue;
+        }
+        if (keyword == "end" && nestedDepth > 0)
+        {
+            --nestedDepth;
+            continue;
+        }
+        if (nestedDepth > 0)
+            continue;
+
+        if (keyword != "end")
+        {
+            if (keyword == "position" || keyword == "pos")
+                words >> pos[0] >> pos[1] >> pos[2];
+            else if (keyword == "size")
+            {
+                if (words >> size[0] && !(words >> size[1] >> size[2]))
+                    size[1] = size[2] = size[0];
+            }
+            else if (keyword == "rotation" || keyword == "rot")
+                words >> rotation;
+            else if (keyword == "flipz")
+                flipZ = true;
+            else if (keyword == "vertex")
+            {
+                float vertex[3] = {0.0f, 0.0f, 0.0f};
+                words >> vertex[0] >> vertex[1] >> vertex[2];
+                vertices.insert(vertices.end(), vertex, vertex + 3);
+            }
+            else if (keyword == "vertices" && block == "mesh")
+            {
+                faces.push_back(std::vector<int>());
+                int index;
+                while (words >> index)
+                    faces.back().push_back(index);
+            }
+            else if (keyword == "shift" || keyword == "scale" || keyword == "shear" || keyword == "spin")
+                ++skipped["transforms"];
+            continue;
+        }
+
+        // The position of boxes and pyramids is the middle of the bottom, and size is half of the width and depth
+        if (block == "box" || block == "base" || block == "meshbox")
+        {
+            float center[3] = {pos[0], pos[1], pos[2] + size[2] / 2.0f};
+            float halfSize[3] = {size[0], size[1], size[2] / 2.0f};
+            addBox(center, halfSize, rotation);
+        }
+        else if (block == "pyramid" || block == "meshpyr")
+        {
+            float cosRotation = (float)cos(rotation * M_PI / 180.0), sinRotation = (float)sin(rotation * M_PI / 180.0);
+            float height = fabsf(size[2]);
+            bool flipped = flipZ || size[2] < 0.0f;
+            float baseZ = flipped ? pos[2] + height : pos[2];
+            float apex[3] = {pos[0], pos[1], flipped ? pos[2] : pos[2] + height};
+            float corners[4][3];
+            const float signs[4][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}};
+            for (int i = 0; i < 4; ++i)
+            {
+                float x = signs[i][0] * size[0], y = signs[i][1] * size[1];
+                corners[i][0] = pos[0] + x * cosRotation - y * sinRotation;
+                corners[i][1] = pos[1] + x * sinRotation + y * cosRotation;
+                corners[i][2] = baseZ;
+            }
+            for (int i = 0; i < 4; ++i)
+                addTriangle(corners[i], corners[(i + 1) % 4], apex);
+            addTriangle(corners[0], corners[1], corners[2]);
+            addTriangle(corners[0], corners[2], corners[3]);
+        }
+        else if (block == "tetra" && vertices.size() == 12)
+        {
+            const float* v = &vertices[0];
+            addTriangle(v, v + 3, v + 6);
+            addTriangle(v, v + 3, v + 9);
+            addTriangle(v, v + 6, v + 9);
+            addTriangle(v + 3, v + 6, v + 9);
+        }
+        else if (block == "mesh")
+        {
+            // Faces can have any number of corners, so split them into a fan of triangles
+            const int vertexCount = (int)vertices.size() / 3;
+            for (auto &face : faces)
+            {
+                bool valid = face.size() >= 3;
+                for (int index : face)
+                    valid = valid && index >= 0 && index < vertexCount;
+                if (!valid)
+                {
+                    ++skipped["mesh faces"];
+                    continue;
+                }
+
+                for (size_t i = 2; i < face.size(); ++i)
+                    addTriangle(&vertices[face[0] * 3], &vertices[face[i - 1] * 3], &vertices[face[i] * 3]);
+            }
+        }
+        else if (block == "world")
+            worldHalfSize = size[0];
+        else if (block != "options" && block != "teleporter" && block != "link" && block != "zone" && block != "weapon"
+                 && block != "material" && block != "physics" && block != "dynamiccolor" && block != "texturematrix"
+                 && block != "waterlevel" && block != "transform")
+            ++skipped[block];
+
+        block.clear();
+    }
+
+    for (auto &skip : skipped)
+        bz_debugMessagef(1, "WARNING: Ricochets ignore %d %s in %s", skip.second, skip.first.c_str(), worldFile);
+
+    return true;
+}
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4
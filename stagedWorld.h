@@ -0,0 +1,124 @@
+// stagedSceneGenerator
+// The world obstacles that staged shots ricochet off of, used to work out where a
+// shot is after it has bounced. See README.stagedSceneGenerator.txt
+
+/*
+Copyright (c) 2018 Scott Wichser
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies,
+either expressed or implied, of the FreeBSD Project.
+
+*/
+
+#ifndef STAGED_WORLD_H
+#define STAGED_WORLD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct WorldHit
+{
+    float distance;
+    float point[3];
+    float normal[3];
+
+    // Shots end when they hit the ground instead of bouncing
+    bool ground;
+};
+
+// Every obstacle is stored as boxes and triangles with a bounding volume hierarchy over them, so tracing a shot only
+// tests the handful of obstacles near its path.
+class StagedWorld
+{
+public:
+    // Read the obstacles from a .bzw file. Boxes, bases, meshboxes, pyramids, tetras and meshes are supported.
+    bool readWorldFile(const char* worldFile);
+
+    // The outer walls are at +/- half of the world size, or there are none if it is 0
+    void setWorldSize(float size);
+
+    // A box is given by its center, half of its size along each axis and its rotation around z in degrees
+    void addBox(const float center[3], const float halfSize[3], float rotation);
+    void addTriangle(const float a[3], const float b[3], const float c[3]);
+
+    // Must be called after adding obstacles and before tracing
+    void build();
+
+    bool trace(const float origin[3], const float dir[3], float maxDistance, WorldHit &hit) const;
+
+    // Whether an upright cylinder standing at base touches any obstacle or is outside of the outer walls. Triangles are
+    // checked by their bounds, so this can report a touch near a sloped face that isn't really there.
+    bool blocksCylinder(const float base[3], float radius, float height) const;
+
+    // Move a shot along its path to just after its last bounce. Returns false if it hits the ground or never hits
+    // anything before then.
+    bool ricochet(float pos[3], float dir[3], int bounces) const;
+
+    size_t obstacleCount() const
+    {
+        return primitives.size();
+    }
+
+private:
+    struct Primitive
+    {
+        bool isBox;
+        float min[3], max[3];
+
+        // Boxes
+        float center[3], halfSize[3];
+        float cosRotation, sinRotation;
+
+        // Triangles
+        float vertex[3][3];
+    };
+
+    // Children of an inner node are the next node and the node at right. Leaves have a count of primitives starting
+    // at start in the sorted primitive list.
+    struct Node
+    {
+        float min[3], max[3];
+        uint32_t start, count;
+        uint32_t right;
+    };
+
+    uint32_t buildNode(uint32_t start, uint32_t count);
+    bool hitPrimitive(const Primitive &primitive, const float origin[3], const float dir[3], float maxDistance, WorldHit &hit) const;
+
+    std::vector<Primitive> primitives;
+    std::vector<Node> nodes;
+    float worldHalfSize = 0.0f;
+};
+
+#endif // STAGED_WORLD_H
+
+// Local Variables: ***
+// mode: C++ ***
+// tab-width: 4 ***
+// c-basic-offset: 4 ***
+// indent-tabs-mode: nil ***
+// End: ***
+// ex: shiftwidth=4 tabstop=4